@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#define CHECKPOINT_MAGIC "NTHUCKPT"
+#define CHECKPOINT_VERSION 1
+
+// The progress of a run, so that a run that crashed can resume instead of
+// transforming every item again: the keys the Writer has written, of the n
+// keys from first_key, and how many bytes of the output file they take.
+//
+// The Writer marks every key it writes and saves now and then: it makes the
+// output durable up to offset first, then writes the file under a temporary
+// name, syncs it and renames it over the previous one, so the file on disk
+// always describes a prefix of the output that is on disk too. A run that
+// starts with the file present truncates the output to offset, the Reader
+// skips the keys written and the Writer expects the others only.
+//
+// The keys are indexed from first_key, so an input with a checkpoint has to
+// hold each of them exactly once: the Reader checks that with read before
+// it looks the key up.
+//
+// The file is a header and the keys written past the prefix of keys all
+// written, one bit each; in key order (an ordered output queue) the prefix
+// is all of them.
+class Checkpoint {
+public:
+	// constructor, for the n keys from first_key
+	Checkpoint(std::string file, int first_key, int n);
+
+	// read the file if there is one, returns false and prints why if it
+	// cannot be read or is of another run
+	bool load();
+
+	// the range of keys, [first_key, first_key + n)
+	int get_first_key();
+	int get_n();
+
+	// record that the Reader read key, false if it is out of the range or
+	// was read before
+	bool read(int key);
+
+	// of the run the file was loaded from, for the Reader
+	bool was_written(int key);
+	int get_resumed();
+	// the first key not written, all the keys before it were
+	int get_resume_key();
+	size_t get_offset();
+
+	// mark key written, by the Writer
+	void mark(int key);
+
+	// durably record the keys marked so far, their output taking the first
+	// offset bytes of the output file, which is durable already
+	void save(size_t offset);
+
+	// remove the file, the run is complete
+	void remove();
+private:
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		int32_t first_key;
+		int32_t n;
+		// the keys [first_key, first_key + prefix) are all written
+		int32_t prefix;
+		uint64_t offset;
+	};
+
+	std::string file;
+	int first_key;
+	int n;
+
+	// what the loaded file says, read by the Reader while the Writer marks
+	std::vector<bool> resumed;
+	int resumed_count;
+	int resumed_prefix;
+	size_t resumed_offset;
+
+	// the keys the Reader has read in this run
+	std::vector<bool> seen;
+
+	// what the Writer has written, including what it resumed from
+	std::vector<bool> written;
+	int prefix;
+
+	// write all of [buffer, buffer + size) to fd, false if it fails
+	static bool write_all(int fd, const char* buffer, size_t size);
+};
+
+// Implementation start
+
+Checkpoint::Checkpoint(std::string file, int first_key, int n)
+	: file(file), first_key(first_key), n(n), resumed(n, false), resumed_count(0), resumed_prefix(0),
+	resumed_offset(0), seen(n, false), written(n, false), prefix(0) {
+}
+
+bool Checkpoint::load() {
+	FILE* in = fopen(file.c_str(), "rb");
+	if (!in)
+		return true;
+
+	Header header;
+	bool ok = fread(&header, sizeof(header), 1, in) == 1 && memcmp(header.magic, CHECKPOINT_MAGIC, 8) == 0 &&
+		header.version == CHECKPOINT_VERSION;
+	if (!ok) {
+		fprintf(stderr, "the checkpoint %s cannot be read\n", file.c_str());
+		fclose(in);
+		return false;
+	}
+	if (header.first_key != first_key || header.n != n || header.prefix < 0 || header.prefix > n) {
+		fprintf(stderr, "the checkpoint %s is of keys [%d, %d), not of this run, remove it to start over\n",
+			file.c_str(), header.first_key, header.first_key + header.n);
+		fclose(in);
+		return false;
+	}
+
+	std::vector<unsigned char> bits((n - header.prefix + 7) / 8);
+	if (!bits.empty() && fread(bits.data(), bits.size(), 1, in) != 1) {
+		fprintf(stderr, "the checkpoint %s is truncated\n", file.c_str());
+		fclose(in);
+		return false;
+	}
+	fclose(in);
+
+	for (int i = 0; i < n; i++) {
+		int bit = i - header.prefix;
+		resumed[i] = bit < 0 || (bits[bit / 8] >> (bit % 8) & 1);
+		resumed_count += resumed[i];
+	}
+	resumed_prefix = header.prefix;
+	resumed_offset = header.offset;
+	written = resumed;
+	prefix = header.prefix;
+	return true;
+}
+
+int Checkpoint::get_first_key() {
+	return first_key;
+}
+
+int Checkpoint::get_n() {
+	return n;
+}
+
+bool Checkpoint::read(int key) {
+	int i = key - first_key;
+	if (i < 0 || i >= n || seen[i])
+		return false;
+	seen[i] = true;
+	return true;
+}
+
+bool Checkpoint::was_written(int key) {
+	int i = key - first_key;
+	return i >= 0 && i < n && resumed[i];
+}
+
+int Checkpoint::get_resumed() {
+	return resumed_count;
+}
+
+int Checkpoint::get_resume_key() {
+	return first_key + resumed_prefix;
+}
+
+size_t Checkpoint::get_offset() {
+	return resumed_offset;
+}
+
+void Checkpoint::mark(int key) {
+	int i = key - first_key;
+	assert(i >= 0 && i < n);
+	written[i] = true;
+	while (prefix < n && written[prefix])
+		prefix++;
+}
+
+bool Checkpoint::write_all(int fd, const char* buffer, size_t size) {
+	while (size > 0) {
+		ssize_t count = write(fd, buffer, size);
+		if (count <= 0)
+			return false;
+		buffer += count;
+		size -= count;
+	}
+	return true;
+}
+
+void Checkpoint::save(size_t offset) {
+	Header header;
+	memcpy(header.magic, CHECKPOINT_MAGIC, 8);
+	header.version = CHECKPOINT_VERSION;
+	header.first_key = first_key;
+	header.n = n;
+	header.prefix = prefix;
+	header.offset = offset;
+
+	std::vector<unsigned char> bits((n - prefix + 7) / 8, 0);
+	for (int i = prefix; i < n; i++)
+		if (written[i])
+			bits[(i - prefix) / 8] |= 1 << ((i - prefix) % 8);
+
+	std::string temporary = file + ".tmp";
+	int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	assert(fd >= 0);
+	bool ok = write_all(fd, (const char*)&header, sizeof(header)) &&
+		write_all(fd, (const char*)bits.data(), bits.size());
+	assert(ok && "cannot write the checkpoint");
+	fsync(fd);
+	close(fd);
+	rename(temporary.c_str(), file.c_str());
+
+	// the rename is durable once the directory is
+	size_t slash = file.rfind('/');
+	std::string directory = slash == std::string::npos ? "." : file.substr(0, slash + 1);
+	int directory_fd = open(directory.c_str(), O_RDONLY);
+	if (directory_fd >= 0) {
+		fsync(directory_fd);
+		close(directory_fd);
+	}
+}
+
+void Checkpoint::remove() {
+	unlink(file.c_str());
+	// left behind by a save that was cut short
+	unlink((file + ".tmp").c_str());
+}
+
+#endif // CHECKPOINT_HPP
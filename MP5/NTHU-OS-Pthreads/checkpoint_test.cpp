@@ -0,0 +1,49 @@
+#include <assert.h>
+#include <stdio.h>
+#include "checkpoint.hpp"
+
+int main() {
+	std::string file = "./tests/checkpoint_test.checkpoint";
+	// left by a run of the test that failed
+	remove(file.c_str());
+
+	// keys 10 to 109: 10 to 59 written in order, then every third one from 61
+	Checkpoint first(file, 10, 100);
+	assert(first.load() && first.get_resumed() == 0 && first.get_resume_key() == 10);
+	for (int key = 10; key < 60; key++)
+		first.mark(key);
+	for (int key = 61; key < 110; key += 3)
+		first.mark(key);
+	first.save(1234);
+
+	Checkpoint resumed(file, 10, 100);
+	assert(resumed.load());
+	printf("resumed %d keys from key %d at offset %zu\n", resumed.get_resumed(), resumed.get_resume_key(),
+		resumed.get_offset());
+	assert(resumed.get_resumed() == 50 + 17);
+	assert(resumed.get_resume_key() == 60);
+	assert(resumed.get_offset() == 1234);
+	for (int key = 0; key < 120; key++)
+		assert(resumed.was_written(key) == (key >= 10 && key < 110 && (key < 60 || (key > 60 && (key - 61) % 3 == 0))));
+
+	// the keys written since do not change what the run resumed from
+	for (int key = 60; key < 110; key += 3)
+		resumed.mark(key);
+	assert(!resumed.was_written(60));
+
+	// the Reader reads each key of the range once, and no other
+	for (int key = 10; key < 110; key++)
+		assert(resumed.read(key));
+	assert(!resumed.read(10) && !resumed.read(109));
+	assert(!resumed.read(9) && !resumed.read(110) && !resumed.read(70 * 7));
+
+	// a checkpoint of other keys is refused
+	Checkpoint other(file, 1, 100);
+	assert(!other.load());
+
+	resumed.remove();
+	Checkpoint removed(file, 10, 100);
+	assert(removed.load() && removed.get_resumed() == 0);
+
+	return 0;
+}
@@ -1,83 +1,68 @@
 #include <pthread.h>
-#include <stdio.h>
-#include "thread.hpp"
-#include "ts_queue.hpp"
+#include "stage.hpp"
+#include "queue.hpp"
 #include "item.hpp"
 #include "transformer.hpp"
+#include "item_batch.hpp"
 
 #ifndef CONSUMER_HPP
 #define CONSUMER_HPP
 
-class Consumer : public Thread {
+// The consumer stage: the consumer transform of every item, batched by opcode.
+// The ConsumerController parks and resumes consumers with cancel and resume.
+// E is how the queues carry the items, Item* (a Consumer) or Item.
+template <class E>
+class BasicConsumer : public Stage<E, E> {
 public:
-	// constructor
-	Consumer(TSQueue<Item*>* worker_queue, TSQueue<Item*>* output_queue, Transformer* transformer);
+	// constructor, with soa the batches are transformed as an ItemBatch
+	BasicConsumer(Queue<E>* worker_queue, Queue<E>* output_queue, Transformer* transformer, int batch_size = 1,
+		bool soa = false);
 
 	// destructor
-	~Consumer();
+	~BasicConsumer();
 
-	virtual void start() override;
-
-	virtual int cancel() override;
+	// look the transforms up in a cache shared with the other stages, before start
+	void set_cache(TransformCache* cache);
+protected:
+	virtual int work(E* items, int n, E* outputs) override;
 private:
-	TSQueue<Item*>* worker_queue;
-	TSQueue<Item*>* output_queue;
-
 	Transformer* transformer;
 
-	bool is_cancel;
-
-	// the method for pthread to create a consumer thread
-	static void* process(void* arg);
+	OpcodeBatcher batcher;
+	ItemBatch batch;
+	bool soa;
 };
 
-Consumer::Consumer(TSQueue<Item*>* worker_queue, TSQueue<Item*>* output_queue, Transformer* transformer)
-	: worker_queue(worker_queue), output_queue(output_queue), transformer(transformer) {
-	is_cancel = false;
-}
-
-Consumer::~Consumer() {}
+typedef BasicConsumer<Item*> Consumer;
 
-void Consumer::start() {
-	// TODO: starts a Consumer thread
-	/*int pthread_create(pthread_t *restrict thread,
-                          const pthread_attr_t *restrict attr,
-                          void *(*start_routine)(void *),
-                          void *restrict arg);*/
-	pthread_create(&t, 0, Consumer::process, (void*) this);
+template <class E>
+BasicConsumer<E>::BasicConsumer(Queue<E>* worker_queue, Queue<E>* output_queue, Transformer* transformer,
+	int batch_size, bool soa)
+	: Stage<E, E>(worker_queue, output_queue, batch_size), transformer(transformer), batcher(batch_size),
+	batch(batch_size), soa(soa) {
+	this->role = ROLE_CONSUMER;
 }
 
-int Consumer::cancel() {
-	// TODO: cancels the consumer thread
-	is_cancel = true;
-	return is_cancel;
-}
+template <class E>
+BasicConsumer<E>::~BasicConsumer() {}
 
-void* Consumer::process(void* arg) {
-	Consumer* consumer = (Consumer*)arg;
-	//https://blog.csdn.net/hslinux/article/details/7929182
-	//A cancellation request is deferred 
-	//until the thread next calls a function that is a cancellation point
-	pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, nullptr);
-	
-	while (!consumer->is_cancel) {
-		//disable cancellation for a while, 
-		//so that we don't immediately react to a cancellation request
-		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, nullptr);
+template <class E>
+void BasicConsumer<E>::set_cache(TransformCache* cache) {
+	batcher.set_cache(cache, TRANSFORM_CONSUMER);
+	batch.set_cache(cache, TRANSFORM_CONSUMER);
+}
 
-		// TODO: implements the Consumer's work
-		Item* it = consumer->worker_queue->dequeue();
-		it -> val = consumer->transformer->consumer_transform(it->opcode, it->val);
-		consumer->output_queue->enqueue(it);
-		
-		
-		//re-enable cancellation
-		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, nullptr);
+template <class E>
+int BasicConsumer<E>::work(E* items, int n, E* outputs) {
+	if (soa) {
+		batch.load(items, n);
+		batch.transform(transformer, &Transformer::consumer_transform_batch);
+		batch.store(items);
+	} else {
+		batcher.transform(items, n, transformer, &Transformer::consumer_transform_batch);
 	}
-
-	delete consumer;
-
-	return nullptr;
+	std::copy(items, items + n, outputs);
+	return n;
 }
 
 #endif // CONSUMER_HPP
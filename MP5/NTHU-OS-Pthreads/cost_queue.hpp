@@ -0,0 +1,214 @@
+#include <pthread.h>
+#include <algorithm>
+#include <vector>
+#include "queue.hpp"
+#include "item.hpp"
+#include "transformer.hpp"
+
+#ifndef COST_QUEUE_HPP
+#define COST_QUEUE_HPP
+
+// A worker queue scheduling the items by the cost of their next transform,
+// one FIFO lane per opcode. A FIFO queue makes the cheap items wait behind
+// the expensive ones; this one dequeues the lane whose head has the highest
+// response ratio (wait + cost) / cost, which is shortest job first while the
+// heads are fresh, and lets an expensive item through once it has waited
+// long enough compared to its cost, so no lane starves.
+//
+// The cost of an opcode is the iterations of its TransformSpec, and the
+// waits are measured on the same scale: the clock of the queue advances by
+// the cost of every item dequeued, the work the consumers have been given.
+class CostQueue : public Queue<Item*> {
+public:
+	// spec gives the TransformSpec of the stage dequeuing, Transformer::producer_spec
+	// or Transformer::consumer_spec, without one every opcode costs the same
+	explicit CostQueue(int size, const TransformSpec* (*spec)(char opcode) = nullptr);
+
+	// destructor
+	~CostQueue();
+
+	// add an item to the end of the lane of its opcode
+	virtual void enqueue(Item* item) override;
+
+	// remove and return the head of the lane with the highest response ratio
+	virtual Item* dequeue() override;
+
+	// add n items under one lock round-trip
+	virtual void enqueue_bulk(Item** items, int n) override;
+
+	// remove up to max items under one lock round-trip, picking the lane of each
+	virtual int dequeue_bulk(Item** items, int max, const std::atomic<bool>* cancel = nullptr) override;
+
+	// wake the threads blocked in dequeue_bulk
+	virtual void wake_dequeuers() override;
+
+	// return the number of items in all the lanes
+	virtual int get_size() override;
+private:
+	struct Entry {
+		Item* item;
+		// the clock when the item was enqueued
+		long long enqueue_clock;
+	};
+
+	// a ring of up to capacity entries, allocated with the first item of its opcode
+	struct Lane {
+		Entry* ring;
+		int head;
+		int size;
+		long long cost;
+	};
+
+	const TransformSpec* (*spec)(char opcode);
+
+	Lane lanes[256];
+	// the opcodes with a lane
+	std::vector<unsigned char> opcodes;
+
+	int capacity;
+	int size;
+	// the sum of the costs of the items dequeued so far
+	long long clock;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond_enqueue, cond_dequeue;
+
+	void push(Item* item);
+
+	// the lane to dequeue from next, there is at least one item
+	Lane* pick();
+};
+
+// Implementation start
+
+CostQueue::CostQueue(int size, const TransformSpec* (*spec)(char opcode))
+	: spec(spec), capacity(size), size(0), clock(0) {
+	for (Lane& lane : lanes) {
+		lane.ring = nullptr;
+		lane.head = 0;
+		lane.size = 0;
+		lane.cost = 1;
+	}
+
+	pthread_mutex_init(&mutex, nullptr);
+	pthread_cond_init(&cond_enqueue, nullptr);
+	pthread_cond_init(&cond_dequeue, nullptr);
+}
+
+CostQueue::~CostQueue() {
+	for (Lane& lane : lanes)
+		delete[] lane.ring;
+
+	pthread_mutex_destroy(&mutex);
+	pthread_cond_destroy(&cond_enqueue);
+	pthread_cond_destroy(&cond_dequeue);
+}
+
+void CostQueue::push(Item* item) {
+	unsigned char opcode = item->opcode;
+	Lane& lane = lanes[opcode];
+	if (!lane.ring) {
+		lane.ring = new Entry[capacity];
+		if (spec)
+			lane.cost = std::max(1, spec(opcode)->iterations);
+		opcodes.push_back(opcode);
+	}
+
+	lane.ring[(lane.head + lane.size) % capacity] = Entry{item, clock};
+	lane.size++;
+	size++;
+}
+
+CostQueue::Lane* CostQueue::pick() {
+	Lane* best = nullptr;
+	double best_ratio = 0;
+	for (unsigned char opcode : opcodes) {
+		Lane& lane = lanes[opcode];
+		if (lane.size == 0)
+			continue;
+
+		double wait = clock - lane.ring[lane.head].enqueue_clock;
+		double ratio = (wait + lane.cost) / lane.cost;
+		// the fresh heads all have a ratio of 1, the cheapest goes first
+		if (!best || ratio > best_ratio || (ratio == best_ratio && lane.cost < best->cost)) {
+			best = &lane;
+			best_ratio = ratio;
+		}
+	}
+	return best;
+}
+
+void CostQueue::enqueue(Item* item) {
+	enqueue_bulk(&item, 1);
+}
+
+Item* CostQueue::dequeue() {
+	Item* item;
+	dequeue_bulk(&item, 1);
+	return item;
+}
+
+void CostQueue::enqueue_bulk(Item** items, int n) {
+	pthread_mutex_lock(&mutex);
+
+	while (n > 0) {
+		while (size >= capacity) {
+			this->wait(&cond_enqueue, &mutex, true);
+		}
+
+		int count = std::min(n, capacity - size);
+		for (int i = 0; i < count; i++)
+			push(items[i]);
+		items += count;
+		n -= count;
+		if (this->stats)
+			this->stats->record_enqueue(count, size);
+
+		pthread_cond_broadcast(&cond_dequeue);
+	}
+
+	pthread_mutex_unlock(&mutex);
+}
+
+int CostQueue::dequeue_bulk(Item** items, int max, const std::atomic<bool>* cancel) {
+	pthread_mutex_lock(&mutex);
+
+	while (size <= 0) {
+		// checked under the lock wake_dequeuers takes, so a wake-up is never missed
+		if (cancel && cancel->load()) {
+			pthread_mutex_unlock(&mutex);
+			return 0;
+		}
+		this->wait(&cond_dequeue, &mutex, false);
+	}
+
+	int count = std::min(max, size);
+	for (int i = 0; i < count; i++) {
+		Lane* lane = pick();
+		items[i] = lane->ring[lane->head].item;
+		lane->head = (lane->head + 1) % capacity;
+		lane->size--;
+		clock += lane->cost;
+	}
+	size -= count;
+	if (this->stats)
+		this->stats->record_dequeue(count, size);
+
+	pthread_cond_broadcast(&cond_enqueue);
+
+	pthread_mutex_unlock(&mutex);
+
+	return count;
+}
+
+void CostQueue::wake_dequeuers() {
+	pthread_mutex_lock(&mutex);
+	pthread_cond_broadcast(&cond_dequeue);
+	pthread_mutex_unlock(&mutex);
+}
+
+int CostQueue::get_size() {
+	return size;
+}
+
+#endif // COST_QUEUE_HPP
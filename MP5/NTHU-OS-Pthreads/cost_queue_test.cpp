@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <assert.h>
+#include <vector>
+#include "cost_queue.hpp"
+
+// the costs of the opcodes for the tests, not those of the transformer
+const TransformSpec* test_spec(char opcode) {
+	static TransformSpec specs[256];
+	static bool made = false;
+	if (!made) {
+		const char* opcodes = "ABCDE";
+		const int costs[] = {10, 1, 50, 40, 5};
+		for (int i = 0; i < 5; i++)
+			specs[(unsigned char)opcodes[i]].iterations = costs[i];
+		made = true;
+	}
+	return &specs[(unsigned char)opcode];
+}
+
+// Ten rounds of every opcode in opcode order, the first 20 enqueued at once,
+// then one more for every dequeue: the cheap B items go first, then the
+// others by response ratio, the expensive C and D ones last but in the end.
+// Every lane stays FIFO.
+void test_order() {
+	CostQueue* q = new CostQueue(20, test_spec);
+
+	Item* items[50];
+	const char* opcodes = "ABCDE";
+	for (int i = 0; i < 50; i++)
+		items[i] = new Item(i + 1, 0, opcodes[i % 5]);
+
+	const int expected[50] = {
+		2, 7, 12, 17, 22, 5, 10, 15, 27, 20, 25, 1, 6, 32, 30, 11, 16, 21, 37, 26,
+		35, 31, 36, 42, 40, 4, 45, 41, 47, 9, 14, 46, 50, 19, 24, 29, 34, 39, 3, 8,
+		13, 44, 18, 23, 28, 49, 33, 38, 43, 48
+	};
+
+	q->enqueue_bulk(items, 20);
+	for (int i = 0; i < 50; i++) {
+		Item* item = q->dequeue();
+		printf("%d%c ", item->key, item->opcode);
+		assert(item->key == expected[i]);
+		if (i < 30)
+			q->enqueue(items[20 + i]);
+	}
+	printf("\n");
+	assert(q->get_size() == 0);
+
+	for (int i = 0; i < 50; i++)
+		delete items[i];
+	delete q;
+}
+
+// an expensive D item waiting behind a steady stream of cheap B items is
+// served once its response ratio passes theirs, ahead of the B items that
+// arrive after that
+void test_no_starvation() {
+	CostQueue* q = new CostQueue(20, test_spec);
+
+	Item expensive(0, 0, 'D');
+	q->enqueue(&expensive);
+	std::vector<Item*> cheap;
+	for (int i = 1; i <= 2; i++) {
+		cheap.push_back(new Item(i, 0, 'B'));
+		q->enqueue(cheap.back());
+	}
+
+	// with two B items queued the head has waited 1 when it is dequeued, a
+	// ratio of 2, which the D passes once it has waited more than its cost
+	// of 40, after 41 B items
+	int served = -1;
+	for (int round = 0; round < 100 && served < 0; round++) {
+		Item* item = q->dequeue();
+		if (item == &expensive)
+			served = round;
+		cheap.push_back(new Item(3 + round, 0, 'B'));
+		q->enqueue(cheap.back());
+	}
+	printf("the D item was served after %d B items\n", served);
+	assert(served == 41);
+
+	while (q->get_size() > 0)
+		assert(q->dequeue()->opcode == 'B');
+	for (Item* item : cheap)
+		delete item;
+	delete q;
+}
+
+int main() {
+	test_order();
+	test_no_starvation();
+	printf("cost_queue_test passed\n");
+	return 0;
+}
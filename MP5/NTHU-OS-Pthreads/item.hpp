@@ -1,8 +1,13 @@
+#include <pthread.h>
+#include <string.h>
 #include <iostream>
+#include <vector>
 
 #ifndef ITEM_HPP
 #define ITEM_HPP
 
+// 16 bytes, the widest field first so there is no padding between the
+// fields, four to a cache line in the ring of a queue of Items by value
 class Item {
 public:
 	Item();
@@ -12,21 +17,223 @@ public:
 	friend std::ostream& operator<<(std::ostream& os, const Item& item);
 	friend std::istream& operator>>(std::istream& in, Item& item);
 
-	int key;
 	unsigned long long val;
+	int key;
 	char opcode;
 };
 
+static_assert(sizeof(Item) == 16, "an Item is packed in 16 bytes");
+
+// the Item of a queue element, the queues carry items by pointer or by value
+static inline Item& item_ref(Item* item) {
+	return *item;
+}
+
+static inline Item& item_ref(Item& item) {
+	return item;
+}
+
+// the longest "key val opcode\n" line format_item can write
+#define ITEM_MAX_TEXT_LENGTH 40
+
+// write item to out exactly like operator<< does, without iostream formatting,
+// and return the end of the written text
+char* format_item(char* out, const Item& item);
+
+#define ITEM_POOL_SLAB_SIZE 256
+#define ITEM_POOL_CACHE_SIZE 64
+
+// A slab allocator for Items.
+// Items are carved out of slabs of ITEM_POOL_SLAB_SIZE and recycled through
+// a shared free list, so the number of Items ever allocated is bounded by
+// how many are in flight in the pipeline, not by the input length.
+class ItemPool {
+public:
+	// A free-list cache owned by a single thread, in front of the shared
+	// free list. The pool lock is only taken once every
+	// ITEM_POOL_CACHE_SIZE / 2 acquires or releases.
+	// A cache without a pool falls back to new and delete.
+	class Cache {
+	public:
+		explicit Cache(ItemPool* pool);
+
+		// gives every cached item back to the pool
+		~Cache();
+
+		// take a free item
+		Item* acquire();
+
+		// give back an item that is no longer in use
+		void release(Item* item);
+	private:
+		ItemPool* pool;
+		Item* items[ITEM_POOL_CACHE_SIZE];
+		int count;
+	};
+
+	ItemPool();
+
+	// frees every slab, all items must have been released
+	~ItemPool();
+
+	// return the number of items allocated so far
+	int get_capacity();
+private:
+	// move up to n free items into items, allocating a new slab
+	// when the free list is empty, and return how many were moved
+	int take(Item** items, int n);
+
+	// put n items back on the free list
+	void give(Item** items, int n);
+
+	pthread_mutex_t mutex;
+	// every slab allocated so far
+	std::vector<Item*> slabs;
+	// the items that are not in use
+	std::vector<Item*> free_items;
+};
+
+// the storage of a queue element: a pooled Item by pointer, none by value
+static inline void acquire_item(ItemPool::Cache& cache, Item*& item) {
+	item = cache.acquire();
+}
+
+static inline void acquire_item(ItemPool::Cache&, Item&) {}
+
+static inline void release_item(ItemPool::Cache& cache, Item* item) {
+	cache.release(item);
+}
+
+static inline void release_item(ItemPool::Cache&, Item&) {}
+
 // Implementation start
 
 Item::Item() {}
 
 Item::Item(int key, unsigned long long val, char opcode) :
-	key(key), val(val), opcode(opcode) {
+	val(val), key(key), opcode(opcode) {
 }
 
 Item::~Item() {}
 
+ItemPool::ItemPool() {
+	pthread_mutex_init(&mutex, nullptr);
+}
+
+ItemPool::~ItemPool() {
+	for (Item* slab : slabs)
+		delete[] slab;
+
+	pthread_mutex_destroy(&mutex);
+}
+
+int ItemPool::get_capacity() {
+	pthread_mutex_lock(&mutex);
+	int capacity = slabs.size() * ITEM_POOL_SLAB_SIZE;
+	pthread_mutex_unlock(&mutex);
+	return capacity;
+}
+
+int ItemPool::take(Item** items, int n) {
+	pthread_mutex_lock(&mutex);
+
+	if (free_items.empty()) {
+		Item* slab = new Item[ITEM_POOL_SLAB_SIZE];
+		slabs.push_back(slab);
+		for (int i = ITEM_POOL_SLAB_SIZE - 1; i >= 0; i--)
+			free_items.push_back(&slab[i]);
+	}
+
+	int count = 0;
+	while (count < n && !free_items.empty()) {
+		items[count++] = free_items.back();
+		free_items.pop_back();
+	}
+
+	pthread_mutex_unlock(&mutex);
+	return count;
+}
+
+void ItemPool::give(Item** items, int n) {
+	pthread_mutex_lock(&mutex);
+	free_items.insert(free_items.end(), items, items + n);
+	pthread_mutex_unlock(&mutex);
+}
+
+ItemPool::Cache::Cache(ItemPool* pool) : pool(pool), count(0) {
+}
+
+ItemPool::Cache::~Cache() {
+	if (pool)
+		pool->give(items, count);
+}
+
+Item* ItemPool::Cache::acquire() {
+	if (!pool)
+		return new Item;
+
+	if (count == 0)
+		count = pool->take(items, ITEM_POOL_CACHE_SIZE / 2);
+	return items[--count];
+}
+
+void ItemPool::Cache::release(Item* item) {
+	if (!pool) {
+		delete item;
+		return;
+	}
+
+	if (count == ITEM_POOL_CACHE_SIZE) {
+		// keep half of the cache, so the next release does not flush again
+		pool->give(items + ITEM_POOL_CACHE_SIZE / 2, ITEM_POOL_CACHE_SIZE / 2);
+		count = ITEM_POOL_CACHE_SIZE / 2;
+	}
+	items[count++] = item;
+}
+
+static const char digit_pairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+// write v in decimal, two digits per division
+static inline char* format_unsigned(char* out, unsigned long long v) {
+	char digits[20];
+	char* p = digits + sizeof(digits);
+
+	while (v >= 100) {
+		const char* pair = digit_pairs + (v % 100) * 2;
+		v /= 100;
+		*--p = pair[1];
+		*--p = pair[0];
+	}
+	if (v >= 10) {
+		*--p = digit_pairs[v * 2 + 1];
+		*--p = digit_pairs[v * 2];
+	} else {
+		*--p = '0' + v;
+	}
+
+	size_t length = digits + sizeof(digits) - p;
+	memcpy(out, p, length);
+	return out + length;
+}
+
+char* format_item(char* out, const Item& item) {
+	if (item.key < 0) {
+		*out++ = '-';
+		out = format_unsigned(out, -(long long)item.key);
+	} else {
+		out = format_unsigned(out, item.key);
+	}
+	*out++ = ' ';
+	out = format_unsigned(out, item.val);
+	*out++ = ' ';
+	*out++ = item.opcode;
+	*out++ = '\n';
+	return out;
+}
+
 std::istream& operator>>(std::istream& in, Item& item) {
 	in >> item.key >> item.val >> item.opcode;
 	return in;
@@ -0,0 +1,189 @@
+#include <vector>
+#include <algorithm>
+#include "item.hpp"
+#include "transformer.hpp"
+#include "transform_cache.hpp"
+
+#ifndef ITEM_BATCH_HPP
+#define ITEM_BATCH_HPP
+
+// Transforms a batch of items with one Transformer batch call per opcode,
+// so that the items sharing a TransformSpec run side by side in SIMD lanes.
+class OpcodeBatcher {
+public:
+	// the batches passed to transform hold at most max_items items
+	explicit OpcodeBatcher(int max_items);
+
+	~OpcodeBatcher();
+
+	// transform_batch is Transformer::producer_transform_batch
+	// or Transformer::consumer_transform_batch, the items are Item* or Item
+	template <class E>
+	void transform(E* items, int n, Transformer* transformer,
+		void (Transformer::*transform_batch)(char, unsigned long long*, int));
+
+	// look the values up in cache first, as the transforms of stage
+	void set_cache(TransformCache* cache, TransformStage stage);
+private:
+	// the items of the opcode being transformed, and their values
+	std::vector<Item*> group;
+	std::vector<unsigned long long> vals;
+	// whether the item at the same index of the batch is transformed
+	std::vector<bool> done;
+
+	TransformCache* cache;
+	TransformStage stage;
+	TransformCache::Misses misses;
+};
+
+// A batch of items as a struct of arrays, the values grouped by opcode: a
+// counting sort gathers the values of every opcode contiguously in two
+// passes over the batch, where OpcodeBatcher rescans it once per opcode,
+// each group is transformed in place by one batch call, and store scatters
+// the values back. The optional layout of the transform stages.
+class ItemBatch {
+public:
+	// the batches loaded hold at most max_items items
+	explicit ItemBatch(int max_items);
+
+	~ItemBatch();
+
+	// gather the values of the n items, Item* or Item, by opcode
+	template <class E>
+	void load(E* items, int n);
+
+	// transform every group with one call of transform_batch
+	void transform(Transformer* transformer,
+		void (Transformer::*transform_batch)(char, unsigned long long*, int));
+
+	// write the values back to the items they were loaded from
+	template <class E>
+	void store(E* items);
+
+	// look the values up in cache first, as the transforms of stage
+	void set_cache(TransformCache* cache, TransformStage stage);
+private:
+	// the values grouped by opcode and the index in the batch of each
+	std::vector<unsigned long long> vals;
+	std::vector<int> index;
+	int size;
+
+	// the opcodes of the batch in the order of their groups, where each
+	// group starts, and the count of each opcode, zero outside of load
+	std::vector<char> opcodes;
+	std::vector<int> starts;
+	int counts[256];
+
+	TransformCache* cache;
+	TransformStage stage;
+	TransformCache::Misses misses;
+};
+
+// Implementation start
+
+OpcodeBatcher::OpcodeBatcher(int max_items)
+	: group(max_items), vals(max_items), done(max_items), cache(nullptr), stage(TRANSFORM_PRODUCER) {
+}
+
+OpcodeBatcher::~OpcodeBatcher() {}
+
+void OpcodeBatcher::set_cache(TransformCache* cache, TransformStage stage) {
+	this->cache = cache;
+	this->stage = stage;
+}
+
+template <class E>
+void OpcodeBatcher::transform(E* items, int n, Transformer* transformer,
+	void (Transformer::*transform_batch)(char, unsigned long long*, int)) {
+	std::fill(done.begin(), done.begin() + n, false);
+
+	for (int i = 0; i < n; i++) {
+		if (done[i])
+			continue;
+
+		// gather every remaining item with the opcode of items[i]
+		char opcode = item_ref(items[i]).opcode;
+		int count = 0;
+		for (int j = i; j < n; j++) {
+			Item& item = item_ref(items[j]);
+			if (!done[j] && item.opcode == opcode) {
+				done[j] = true;
+				group[count] = &item;
+				vals[count++] = item.val;
+			}
+		}
+
+		if (cache)
+			cache->transform(stage, opcode, vals.data(), count, transformer, transform_batch, &misses);
+		else
+			(transformer->*transform_batch)(opcode, vals.data(), count);
+
+		for (int j = 0; j < count; j++)
+			group[j]->val = vals[j];
+	}
+}
+
+ItemBatch::ItemBatch(int max_items) : vals(max_items), index(max_items), size(0), cache(nullptr),
+	stage(TRANSFORM_PRODUCER) {
+	std::fill(counts, counts + 256, 0);
+	opcodes.reserve(256);
+	starts.reserve(257);
+}
+
+ItemBatch::~ItemBatch() {}
+
+void ItemBatch::set_cache(TransformCache* cache, TransformStage stage) {
+	this->cache = cache;
+	this->stage = stage;
+}
+
+template <class E>
+void ItemBatch::load(E* items, int n) {
+	opcodes.clear();
+	for (int i = 0; i < n; i++) {
+		unsigned char opcode = item_ref(items[i]).opcode;
+		if (counts[opcode]++ == 0)
+			opcodes.push_back(opcode);
+	}
+
+	starts.clear();
+	int start = 0;
+	for (char opcode : opcodes) {
+		starts.push_back(start);
+		start += counts[(unsigned char)opcode];
+		// from here on the count is the next free position of the group
+		counts[(unsigned char)opcode] = starts.back();
+	}
+	starts.push_back(start);
+
+	for (int i = 0; i < n; i++) {
+		Item& item = item_ref(items[i]);
+		int position = counts[(unsigned char)item.opcode]++;
+		vals[position] = item.val;
+		index[position] = i;
+	}
+
+	for (char opcode : opcodes)
+		counts[(unsigned char)opcode] = 0;
+	size = n;
+}
+
+void ItemBatch::transform(Transformer* transformer,
+	void (Transformer::*transform_batch)(char, unsigned long long*, int)) {
+	for (size_t g = 0; g < opcodes.size(); g++) {
+		unsigned long long* group = vals.data() + starts[g];
+		int count = starts[g + 1] - starts[g];
+		if (cache)
+			cache->transform(stage, opcodes[g], group, count, transformer, transform_batch, &misses);
+		else
+			(transformer->*transform_batch)(opcodes[g], group, count);
+	}
+}
+
+template <class E>
+void ItemBatch::store(E* items) {
+	for (int i = 0; i < size; i++)
+		item_ref(items[index[i]]).val = vals[i];
+}
+
+#endif // ITEM_BATCH_HPP
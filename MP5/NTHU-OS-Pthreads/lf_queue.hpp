@@ -0,0 +1,331 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <atomic>
+#include "queue.hpp"
+
+#ifndef LF_QUEUE_HPP
+#define LF_QUEUE_HPP
+
+#define DEFAULT_LF_BUFFER_SIZE 200
+#define CACHE_LINE_SIZE 64
+// how many times a full/empty queue is retried before the thread goes to sleep
+#define LF_QUEUE_SPIN_COUNT 128
+
+// tell the CPU we are in a busy-wait loop
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+}
+
+// how many times to retry before sleeping: on a single CPU nobody can
+// change the queue while we spin, so go to sleep right away
+static inline int spin_count() {
+	static const int count = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? LF_QUEUE_SPIN_COUNT : 0;
+	return count;
+}
+
+// A bounded multi-producer/multi-consumer lock-free queue
+// (Dmitry Vyukov's sequence-numbered ring buffer).
+//
+// Every slot carries a sequence number: a slot at ring position pos is
+// free for the enqueuer of pos when seq == pos, and holds a value for the
+// dequeuer of pos when seq == pos + 1. Enqueuers and dequeuers only race
+// on their own counter with a CAS, so the two ends never share a lock.
+// Threads fall back to sleeping on a condition variable only when the
+// queue is truly full or empty.
+template <class T>
+class LFQueue : public Queue<T> {
+public:
+	// constructor
+	LFQueue();
+
+	explicit LFQueue(int max_buffer_size);
+
+	// destructor
+	~LFQueue();
+
+	// add an element to the end of the queue
+	virtual void enqueue(T item) override;
+
+	// remove and return the first element of the queue
+	virtual T dequeue() override;
+
+	// add n elements, waking the sleeping consumers once at the end
+	virtual void enqueue_bulk(T* items, int n) override;
+
+	// remove up to max elements, waking the sleeping producers once at the end
+	virtual int dequeue_bulk(T* items, int max, const std::atomic<bool>* cancel = nullptr) override;
+
+	// wake the threads sleeping in dequeue_bulk
+	virtual void wake_dequeuers() override;
+
+	// return the number of elements in the queue
+	virtual int get_size() override;
+
+	// add an element if the queue is not full, never blocks
+	bool try_enqueue(T item);
+
+	// remove the first element if the queue is not empty, never blocks
+	bool try_dequeue(T& item);
+private:
+	struct Slot {
+		std::atomic<unsigned long> seq;
+		T value;
+	};
+
+	// add an element, sleeping while the queue is full, without waking anyone
+	void enqueue_wait(T item);
+
+	// remove an element, sleeping while the queue is empty, without waking anyone,
+	// returns false if cancel is set while the queue is empty
+	bool dequeue_wait(T& item, const std::atomic<bool>* cancel = nullptr);
+
+	// wake up one (or every) sleeping thread if there is any
+	void notify(std::atomic<int>& waiters, pthread_cond_t* cond, bool all);
+
+	// the maximum buffer size
+	int buffer_size;
+	// the ring of slots
+	Slot* buffer;
+
+	// head and tail are kept on their own cache lines,
+	// so that enqueuers and dequeuers do not false-share
+	char pad0[CACHE_LINE_SIZE];
+	// the ring position of the next enqueue
+	std::atomic<unsigned long> enqueue_pos;
+	char pad1[CACHE_LINE_SIZE];
+	// the ring position of the next dequeue
+	std::atomic<unsigned long> dequeue_pos;
+	char pad2[CACHE_LINE_SIZE];
+
+	// the number of threads sleeping on a full or an empty queue
+	std::atomic<int> enqueue_waiters, dequeue_waiters;
+
+	// pthread mutex lock, only taken on the sleeping path
+	pthread_mutex_t mutex;
+	// pthread conditional variable
+	pthread_cond_t cond_enqueue, cond_dequeue;
+};
+
+// Implementation start
+
+template <class T>
+LFQueue<T>::LFQueue() : LFQueue(DEFAULT_LF_BUFFER_SIZE) {
+}
+
+template <class T>
+LFQueue<T>::LFQueue(int buffer_size) : buffer_size(buffer_size) {
+	buffer = new Slot[buffer_size];
+	for (int i = 0; i < buffer_size; i++)
+		buffer[i].seq.store(i, std::memory_order_relaxed);
+
+	enqueue_pos.store(0, std::memory_order_relaxed);
+	dequeue_pos.store(0, std::memory_order_relaxed);
+	enqueue_waiters.store(0, std::memory_order_relaxed);
+	dequeue_waiters.store(0, std::memory_order_relaxed);
+
+	pthread_mutex_init(&mutex, nullptr);
+	pthread_cond_init(&cond_enqueue, nullptr);
+	pthread_cond_init(&cond_dequeue, nullptr);
+}
+
+template <class T>
+LFQueue<T>::~LFQueue() {
+	delete[] buffer;
+
+	pthread_mutex_destroy(&mutex);
+	pthread_cond_destroy(&cond_enqueue);
+	pthread_cond_destroy(&cond_dequeue);
+}
+
+template <class T>
+bool LFQueue<T>::try_enqueue(T item) {
+	unsigned long pos = enqueue_pos.load(std::memory_order_relaxed);
+	Slot* slot;
+
+	while (1) {
+		slot = &buffer[pos % buffer_size];
+		unsigned long seq = slot->seq.load(std::memory_order_acquire);
+		long diff = (long)seq - (long)pos;
+
+		if (diff == 0) {
+			// the slot is free, claim position pos
+			if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		} else if (diff < 0) {
+			// the slot still holds the value of the previous lap: full
+			return false;
+		} else {
+			// another enqueuer claimed pos first
+			pos = enqueue_pos.load(std::memory_order_relaxed);
+		}
+	}
+
+	slot->value = item;
+	slot->seq.store(pos + 1, std::memory_order_release);
+	return true;
+}
+
+template <class T>
+bool LFQueue<T>::try_dequeue(T& item) {
+	unsigned long pos = dequeue_pos.load(std::memory_order_relaxed);
+	Slot* slot;
+
+	while (1) {
+		slot = &buffer[pos % buffer_size];
+		unsigned long seq = slot->seq.load(std::memory_order_acquire);
+		long diff = (long)seq - (long)(pos + 1);
+
+		if (diff == 0) {
+			// the slot holds a value, claim position pos
+			if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		} else if (diff < 0) {
+			// the slot has not been written yet: empty
+			return false;
+		} else {
+			// another dequeuer claimed pos first
+			pos = dequeue_pos.load(std::memory_order_relaxed);
+		}
+	}
+
+	item = slot->value;
+	// hand the slot over to the enqueuer of the next lap
+	slot->seq.store(pos + buffer_size, std::memory_order_release);
+	return true;
+}
+
+template <class T>
+void LFQueue<T>::notify(std::atomic<int>& waiters, pthread_cond_t* cond, bool all) {
+	// pairs with the fence in enqueue_wait/dequeue_wait: either the sleeper
+	// sees our update when it retries, or we see the sleeper here
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (waiters.load(std::memory_order_relaxed) > 0) {
+		pthread_mutex_lock(&mutex);
+		if (all)
+			pthread_cond_broadcast(cond);
+		else
+			pthread_cond_signal(cond);
+		pthread_mutex_unlock(&mutex);
+	}
+}
+
+template <class T>
+void LFQueue<T>::enqueue_wait(T item) {
+	int spin = 0;
+	while (!try_enqueue(item)) {
+		if (spin++ < spin_count()) {
+			cpu_relax();
+			continue;
+		}
+
+		// the queue is full, go to sleep until a dequeue makes room
+		pthread_mutex_lock(&mutex);
+		enqueue_waiters.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		while (!try_enqueue(item)) {
+			this->wait(&cond_enqueue, &mutex, true);
+		}
+		enqueue_waiters.fetch_sub(1);
+		pthread_mutex_unlock(&mutex);
+		break;
+	}
+}
+
+template <class T>
+bool LFQueue<T>::dequeue_wait(T& item, const std::atomic<bool>* cancel) {
+	int spin = 0;
+	while (!try_dequeue(item)) {
+		if (cancel && cancel->load())
+			return false;
+		if (spin++ < spin_count()) {
+			cpu_relax();
+			continue;
+		}
+
+		// the queue is empty, go to sleep until an enqueue arrives
+		bool dequeued = true;
+		pthread_mutex_lock(&mutex);
+		dequeue_waiters.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		while (!try_dequeue(item)) {
+			// checked under the lock wake_dequeuers takes, so a wake-up is never missed
+			if (cancel && cancel->load()) {
+				dequeued = false;
+				break;
+			}
+			this->wait(&cond_dequeue, &mutex, false);
+		}
+		dequeue_waiters.fetch_sub(1);
+		pthread_mutex_unlock(&mutex);
+		return dequeued;
+	}
+	return true;
+}
+
+template <class T>
+void LFQueue<T>::enqueue(T item) {
+	enqueue_wait(item);
+	if (this->stats)
+		this->stats->record_enqueue(1, get_size());
+	notify(dequeue_waiters, &cond_dequeue, false);
+}
+
+template <class T>
+T LFQueue<T>::dequeue() {
+	T item;
+	dequeue_wait(item);
+	if (this->stats)
+		this->stats->record_dequeue(1, get_size());
+	notify(enqueue_waiters, &cond_enqueue, false);
+	return item;
+}
+
+template <class T>
+void LFQueue<T>::enqueue_bulk(T* items, int n) {
+	for (int i = 0; i < n; i++) {
+		if (!try_enqueue(items[i])) {
+			// let the consumers drain what is already in before we sleep
+			notify(dequeue_waiters, &cond_dequeue, true);
+			enqueue_wait(items[i]);
+		}
+	}
+	if (this->stats)
+		this->stats->record_enqueue(n, get_size());
+	notify(dequeue_waiters, &cond_dequeue, true);
+}
+
+template <class T>
+int LFQueue<T>::dequeue_bulk(T* items, int max, const std::atomic<bool>* cancel) {
+	int count = 0;
+	// only the first element is worth waiting for
+	if (!dequeue_wait(items[count++], cancel))
+		return 0;
+	while (count < max && try_dequeue(items[count]))
+		count++;
+	if (this->stats)
+		this->stats->record_dequeue(count, get_size());
+	notify(enqueue_waiters, &cond_enqueue, true);
+	return count;
+}
+
+template <class T>
+void LFQueue<T>::wake_dequeuers() {
+	pthread_mutex_lock(&mutex);
+	pthread_cond_broadcast(&cond_dequeue);
+	pthread_mutex_unlock(&mutex);
+}
+
+template <class T>
+int LFQueue<T>::get_size() {
+	long size = (long)(enqueue_pos.load(std::memory_order_relaxed) -
+		dequeue_pos.load(std::memory_order_relaxed));
+	if (size < 0)
+		return 0;
+	if (size > buffer_size)
+		return buffer_size;
+	return (int)size;
+}
+
+#endif // LF_QUEUE_HPP
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <pthread.h>
+#include <assert.h>
+#include <unistd.h>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include "lf_queue.hpp"
+
+#define PRODUCERS 4
+#define CONSUMERS 3
+#define ITEMS 20000
+// the bulk calls move up to this many items
+#define BULK 7
+
+// the items of every producer, tagged producer * ITEMS + index, through a
+// queue small enough to be full and empty all the time
+LFQueue<int>* q;
+std::atomic<int> received[PRODUCERS * ITEMS];
+std::atomic<int> consumed;
+std::atomic<bool> done;
+
+void* produce(void* arg) {
+	int producer = *(int*)arg;
+
+	// every other batch one by one, the others in bulk
+	int batch[BULK];
+	for (int i = 0; i < ITEMS; i += BULK) {
+		int n = std::min(BULK, ITEMS - i);
+		for (int j = 0; j < n; j++)
+			batch[j] = producer * ITEMS + i + j;
+		if (i / BULK % 2 == 0) {
+			for (int j = 0; j < n; j++)
+				q->enqueue(batch[j]);
+		} else {
+			q->enqueue_bulk(batch, n);
+		}
+	}
+
+	return nullptr;
+}
+
+void* consume(void*) {
+	// the items of one producer reach a consumer in the order they were put in
+	std::vector<int> last(PRODUCERS, -1);
+
+	int items[BULK];
+	while (1) {
+		int n = q->dequeue_bulk(items, BULK, &done);
+		if (n == 0)
+			break;
+		for (int i = 0; i < n; i++) {
+			int producer = items[i] / ITEMS;
+			assert(producer >= 0 && producer < PRODUCERS);
+			assert(items[i] > last[producer]);
+			last[producer] = items[i];
+			received[items[i]].fetch_add(1);
+		}
+		consumed.fetch_add(n);
+	}
+
+	return nullptr;
+}
+
+// every item is received exactly once by PRODUCERS producers and
+// CONSUMERS consumers, the consumers stopping on the cancel flag
+void test_exactly_once() {
+	q = new LFQueue<int>(4);
+	for (int i = 0; i < PRODUCERS * ITEMS; i++)
+		received[i].store(0);
+	consumed.store(0);
+	done.store(false);
+
+	pthread_t producers[PRODUCERS], consumers[CONSUMERS];
+	int ids[PRODUCERS];
+	for (int i = 0; i < CONSUMERS; i++)
+		pthread_create(&consumers[i], 0, consume, nullptr);
+	for (int i = 0; i < PRODUCERS; i++) {
+		ids[i] = i;
+		pthread_create(&producers[i], 0, produce, (void*)&ids[i]);
+	}
+
+	for (int i = 0; i < PRODUCERS; i++)
+		pthread_join(producers[i], 0);
+	while (consumed.load() < PRODUCERS * ITEMS)
+		usleep(1000);
+	done.store(true);
+	q->wake_dequeuers();
+	for (int i = 0; i < CONSUMERS; i++)
+		pthread_join(consumers[i], 0);
+
+	assert(consumed.load() == PRODUCERS * ITEMS);
+	for (int i = 0; i < PRODUCERS * ITEMS; i++)
+		assert(received[i].load() == 1);
+	assert(q->get_size() == 0);
+	delete q;
+}
+
+// the ring positions run past buffer_size many times, the queue staying FIFO
+void test_wrap_around() {
+	LFQueue<int> ring(8);
+	int next_in = 0, next_out = 0;
+	for (int lap = 0; lap < 100; lap++) {
+		// fill up, from wherever the last lap left off
+		while (ring.try_enqueue(next_in))
+			next_in++;
+		assert(ring.get_size() == 8);
+
+		// take some, or all of them every tenth lap
+		int take = lap % 10 == 9 ? 8 : 3;
+		for (int i = 0; i < take; i++) {
+			int item;
+			assert(ring.try_dequeue(item));
+			assert(item == next_out++);
+		}
+	}
+	int item;
+	while (ring.try_dequeue(item))
+		assert(item == next_out++);
+	assert(next_out == next_in && ring.get_size() == 0);
+}
+
+void* fill_later(void* arg) {
+	LFQueue<int>* queue = (LFQueue<int>*)arg;
+	usleep(20000);
+	queue->enqueue(42);
+	return nullptr;
+}
+
+void* drain_later(void* arg) {
+	LFQueue<int>* queue = (LFQueue<int>*)arg;
+	usleep(20000);
+	assert(queue->dequeue() == 0);
+	return nullptr;
+}
+
+void* wait_cancelled(void* arg) {
+	LFQueue<int>* queue = (LFQueue<int>*)arg;
+	int items[BULK];
+	assert(queue->dequeue_bulk(items, BULK, &done) == 0);
+	return nullptr;
+}
+
+// a dequeue asleep on an empty queue wakes for an enqueue, an enqueue asleep
+// on a full one for a dequeue, and dequeue_bulk returns 0 once cancelled
+void test_sleep() {
+	LFQueue<int> queue(2);
+	pthread_t t;
+
+	pthread_create(&t, 0, fill_later, (void*)&queue);
+	assert(queue.dequeue() == 42);
+	pthread_join(t, 0);
+
+	queue.enqueue(0);
+	queue.enqueue(1);
+	pthread_create(&t, 0, drain_later, (void*)&queue);
+	queue.enqueue(2);
+	pthread_join(t, 0);
+	assert(queue.dequeue() == 1 && queue.dequeue() == 2);
+
+	done.store(false);
+	pthread_create(&t, 0, wait_cancelled, (void*)&queue);
+	usleep(20000);
+	done.store(true);
+	queue.wake_dequeuers();
+	pthread_join(t, 0);
+}
+
+int main() {
+	test_wrap_around();
+	test_sleep();
+	test_exactly_once();
+	printf("lf_queue_test passed\n");
+	return 0;
+}
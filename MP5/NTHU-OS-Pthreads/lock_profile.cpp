@@ -0,0 +1,29 @@
+#include <stdio.h>
+#include "lock_profile.hpp"
+
+static const char* thread_role_names[THREAD_ROLES] = {"other", "reader", "producer", "consumer", "router", "writer"};
+
+thread_local ThreadRole thread_role = ROLE_OTHER;
+
+void LockProfile::print(FILE* out, std::string name) {
+	fprintf(out, "%-16s %-9s %10s %8s %12s %10s %10s %12s %9s\n", name.c_str(), "role", "acquired", "missed",
+		"lock wait ms", "hold ms", "cond waits", "cond wait ms", "spurious");
+
+	long long blocked_ns = 0;
+	for (int role = 0; role < THREAD_ROLES; role++) {
+		Role& r = roles[role];
+		long long acquired = r.acquired.load(std::memory_order_relaxed);
+		if (!acquired)
+			continue;
+		long long contended = r.contended.load(std::memory_order_relaxed);
+		long long lock_wait_ns = r.lock_wait_ns.load(std::memory_order_relaxed);
+		long long cond_wait_ns = r.cond_wait_ns.load(std::memory_order_relaxed);
+		blocked_ns += lock_wait_ns + cond_wait_ns;
+
+		fprintf(out, "%-16s %-9s %10lld %7.1f%% %12.3f %10.3f %10lld %12.3f %9lld\n", "",
+			thread_role_names[role], acquired, 100.0 * contended / acquired, lock_wait_ns / 1e6,
+			r.hold_ns.load(std::memory_order_relaxed) / 1e6, r.cond_waits.load(std::memory_order_relaxed),
+			cond_wait_ns / 1e6, r.spurious_wakeups.load(std::memory_order_relaxed));
+	}
+	fprintf(out, "%-16s blocked %.3f ms in all\n", name.c_str(), blocked_ns / 1e6);
+}
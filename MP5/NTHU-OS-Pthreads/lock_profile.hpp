@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <atomic>
+#include <string>
+
+#ifndef LOCK_PROFILE_HPP
+#define LOCK_PROFILE_HPP
+
+// Build with -DTS_QUEUE_PROFILE=1 (make profile) for the TSQueues to record a
+// LockProfile, which costs a trylock and a few clock reads per operation.
+#ifndef TS_QUEUE_PROFILE
+#define TS_QUEUE_PROFILE 0
+#endif
+
+// what the thread using a queue is, set by every Stage for its own thread
+enum ThreadRole {
+	ROLE_OTHER,
+	ROLE_READER,
+	ROLE_PRODUCER,
+	ROLE_CONSUMER,
+	ROLE_ROUTER,
+	ROLE_WRITER,
+	THREAD_ROLES
+};
+
+// the role of the calling thread, one for every translation unit
+// (defined in lock_profile.cpp)
+extern thread_local ThreadRole thread_role;
+
+// Where the threads of each role spent their time on the lock of a queue:
+// waiting to acquire it, holding it, and waiting on its condition variables
+// for room or for items. A wake-up finding the queue still full (or empty)
+// is spurious, the thread waits again.
+struct LockProfile {
+	struct Role {
+		std::atomic<long long> acquired;
+		// the acquisitions a trylock missed, and how long they waited for the lock
+		std::atomic<long long> contended;
+		std::atomic<long long> lock_wait_ns;
+		std::atomic<long long> hold_ns;
+		std::atomic<long long> cond_waits;
+		std::atomic<long long> cond_wait_ns;
+		std::atomic<long long> spurious_wakeups;
+
+		Role() : acquired(0), contended(0), lock_wait_ns(0), hold_ns(0), cond_waits(0), cond_wait_ns(0),
+			spurious_wakeups(0) {}
+	};
+
+	Role roles[THREAD_ROLES];
+
+	// a row per role that used the lock and the blocking time of them all
+	void print(FILE* out, std::string name);
+};
+
+#endif // LOCK_PROFILE_HPP
@@ -1,69 +1,584 @@
-#include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
-#include "ts_queue.hpp"
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <string>
+#include <sstream>
+#include <algorithm>
 #include "item.hpp"
-#include "reader.hpp"
-#include "writer.hpp"
-#include "producer.hpp"
-#include "consumer_controller.hpp"
+#include "transformer.hpp"
+#include "pipeline.hpp"
+#include "telemetry.hpp"
+#include "transform_cache.hpp"
+#include "topology.hpp"
+#include "checkpoint.hpp"
+#include "shard.hpp"
 
+// the queue sizes, can be changed at run time with
+// --input-queue-size, --worker-queue-size and --output-queue-size
 #define READER_QUEUE_SIZE 200
 #define WORKER_QUEUE_SIZE 200
 #define WRITER_QUEUE_SIZE 4000
 #define CONSUMER_CONTROLLER_LOW_THRESHOLD_PERCENTAGE 20
 #define CONSUMER_CONTROLLER_HIGH_THRESHOLD_PERCENTAGE 80
 #define CONSUMER_CONTROLLER_CHECK_PERIOD 1000000
+// the size of the consumer pool the controller scales within,
+// can be changed at run time with --max-consumers
+#define CONSUMER_CONTROLLER_MAX_CONSUMERS 16
+// the number of producers, and the size of their pool with --scale-producers,
+// the number can be changed at run time with --producers
+#define NUM_PRODUCERS 4
+#define PRODUCER_CONTROLLER_MAX_PRODUCERS 16
+
+// How the controllers pick the number of workers: "threshold" (+-1 consumer
+// past the thresholds above), "pid" (PIDPolicy on the queue occupancy) or
+// "latency" (TargetLatencyPolicy, from the measured service times).
+// Can be changed at run time with --scaling, --target-latency (microseconds)
+// and --check-period (microseconds); --scale-producers puts the producers
+// under a ProducerController with the same kind of policy.
+#ifndef SCALING_POLICY
+#define SCALING_POLICY "threshold"
+#endif
+#define TARGET_LATENCY 10000
+
+// With --telemetry FILE the queue, thread and latency stats are sampled into
+// FILE (CSV, or JSON lines for a .json name) every TELEMETRY_PERIOD
+// microseconds, changed with --telemetry-period, and summed up at exit.
+#define TELEMETRY_PERIOD 100000
+
+// The maximum number of items each stage moves per queue operation,
+// can be changed at run time with --reader-batch, --producer-batch,
+// --consumer-batch and --writer-batch.
+#define READER_BATCH_SIZE 64
+#define PRODUCER_BATCH_SIZE 16
+#define CONSUMER_BATCH_SIZE 16
+#define WRITER_BATCH_SIZE 64
+
+// The queue implementation of each queue, "ts" (TSQueue), "futex" (TSQueue with
+// the SpinFutexWaitPolicy: spin, then sleep on a futex), "lockfree" (LFQueue),
+// "stealing" (WSQueue, one deque per consumer, meant for the worker queue)
+// "ordered" (OrderedQueue, the items in key order, for the output queue:
+// its size is the window of the reorder buffer) or "priority" (CostQueue,
+// the cheapest transforms first with aging, for the input or worker queue).
+// Can be changed at build time with -D, or at run time with
+// --input-queue, --worker-queue and --output-queue.
+#ifndef READER_QUEUE_TYPE
+#define READER_QUEUE_TYPE "ts"
+#endif
+#ifndef WORKER_QUEUE_TYPE
+#define WORKER_QUEUE_TYPE "ts"
+#endif
+#ifndef WRITER_QUEUE_TYPE
+#define WRITER_QUEUE_TYPE "ts"
+#endif
+
+// "jump" (O(1) jump-ahead), "iterative" or "verify" (both, asserting they agree),
+// can be changed at run time with --transform
+#ifndef TRANSFORM_MODE
+#define TRANSFORM_MODE "jump"
+#endif
+
+// the SIMD kernel of the batch transforms, "auto", "avx512", "avx2" or "scalar",
+// can be changed at run time with --transform-isa
+#ifndef TRANSFORM_ISA
+#define TRANSFORM_ISA "auto"
+#endif
+
+// "mmap" (hand-written scanner over the mapped file), "stream" (std::ifstream)
+// or "binary" (a mapped file of records, see record.hpp), and how many threads parse the mapped file in parallel chunks,
+// can be changed at run time with --reader and --parse-threads
+#ifndef READER_MODE
+#define READER_MODE "mmap"
+#endif
+#define READER_PARSE_THREADS 1
+
+// "buffered" (format_item into a large buffer and write(2) it when full),
+// "double" (the same with a flush thread writing one buffer while the other fills),
+// "binary" (records, see record.hpp, buffered the same way) or "stream"
+// (std::ofstream), can be changed at run time with --writer
+#ifndef WRITER_MODE
+#define WRITER_MODE "buffered"
+#endif
+
+// With --pipeline FILE the queues and the stages are wired up by the config
+// in FILE (see Pipeline), and the options above only give the defaults of the
+// stages. Without it main runs the pipeline of default_pipeline.
+
+// the reader, the producers, the scaled consumers and the writer
+// over the input, the worker and the output queue
+std::string default_pipeline(std::string input_queue_type, int input_queue_size,
+	std::string worker_queue_type, int worker_queue_size,
+	std::string output_queue_type, int output_queue_size,
+	int reader_batch_size, int producer_batch_size, int consumer_batch_size, int writer_batch_size,
+	int num_producers, bool scale_producers, int max_producers, int max_consumers,
+	std::string scaling_policy, std::string layout) {
+	std::string config;
+	config += "queue input " + input_queue_type + " " + std::to_string(input_queue_size) + "\n";
+	config += "queue worker " + worker_queue_type + " " + std::to_string(worker_queue_size) + "\n";
+	config += "queue output " + output_queue_type + " " + std::to_string(output_queue_size) + "\n";
+
+	config += "stage reader - input batch=" + std::to_string(reader_batch_size) + "\n";
+	config += "stage producer input worker threads=" + std::to_string(num_producers) +
+		" batch=" + std::to_string(producer_batch_size) + " layout=" + layout;
+	if (scale_producers)
+		config += " scale=" + scaling_policy + " max=" + std::to_string(max_producers);
+	config += "\n";
+	config += "stage consumer worker output batch=" + std::to_string(consumer_batch_size) +
+		" layout=" + layout + " scale=" + scaling_policy + " max=" + std::to_string(max_consumers) + "\n";
+	config += "stage writer output - batch=" + std::to_string(writer_batch_size) + "\n";
+	return config;
+}
+
+// With --transform-cache ENTRIES the producers and the consumers share a
+// TransformCache of that many entries, looking up the transforms of the
+// values seen before; 0 (the default) runs without one. A lookup costs more
+// than a jump-ahead transform, the cache pays off with --transform iterative.
+#define TRANSFORM_CACHE_ENTRIES 0
+
+// With --by-value the queues carry the Items themselves, 16 bytes each,
+// instead of pointers to the Items of an ItemPool (see BasicPipeline).
+// --layout soa has the producers and the consumers transform their batches
+// as an ItemBatch, a struct of arrays, instead of with an OpcodeBatcher.
+#ifndef BATCH_LAYOUT
+#define BATCH_LAYOUT "aos"
+#endif
+
+// With --shards N the first n lines of the input are split into N byte
+// ranges at line boundaries, each run through a pipeline of its own, all at
+// once, and written to a part file OUTPUT.partI. The parts are then merged
+// into the output: --merge arrival (the default) puts them one after the
+// other, --merge key merges them by key, for which every pipeline writes in
+// key order: the default pipeline gets an ordered output queue, a --pipeline
+// config has to declare one.
+#define SHARDS 1
+#ifndef MERGE_ORDER
+#define MERGE_ORDER "arrival"
+#endif
+
+// Where the threads of the stages run, see Placement: "none" (wherever the
+// kernel puts them), "llc" (the threads of a pipeline on the CPUs sharing
+// one last-level cache) or "core" (every thread on a CPU of its own in it),
+// can be changed at run time with --placement
+#ifndef PLACEMENT
+#define PLACEMENT "none"
+#endif
+
+// With --checkpoint ITEMS the writer of every pipeline records its progress
+// in OUTPUT.checkpoint (OUTPUT.partI.checkpoint for a shard) every ITEMS
+// items, see Checkpoint. A run finding the file there resumes from it: the
+// items written already are not transformed again. The file is removed once
+// the output is complete. 0 (the default) runs without one.
+#define CHECKPOINT_PERIOD 0
+
+// run a pipeline of the config in pipeline_file, or of default_config without
+// one, for every shard of the input, the queues carrying E, and merge their
+// outputs, return the exit status
+template <class E>
+int run_pipelines(PipelineOptions options, std::string pipeline_file, std::string default_config,
+	std::string telemetry_file, int telemetry_period, int shards, MergeOrder merge_order) {
+	std::vector<InputShard> ranges;
+	if (shards > 1) {
+		ranges = split_input(options.input_file, options.n, shards);
+		if (ranges.empty())
+			return 1;
+	} else {
+		ranges.push_back(InputShard{0, SIZE_MAX, options.n, 1});
+	}
+
+	std::vector<BasicPipeline<E>*> pipelines;
+	std::vector<std::string> parts;
+	for (size_t i = 0; i < ranges.size(); i++) {
+		PipelineOptions shard_options = options;
+		shard_options.n = ranges[i].lines;
+		shard_options.input_begin = ranges[i].begin;
+		shard_options.input_end = ranges[i].end;
+		shard_options.first_key = ranges[i].first_line;
+		if (shards > 1) {
+			shard_options.output_file = options.output_file + ".part" + std::to_string(i);
+			parts.push_back(shard_options.output_file);
+		}
+		if (options.checkpoint_period > 0) {
+			shard_options.checkpoint = new Checkpoint(shard_options.output_file + ".checkpoint",
+				shard_options.first_key, shard_options.n);
+			if (!shard_options.checkpoint->load())
+				return 1;
+			if (shard_options.checkpoint->get_resumed() > 0)
+				printf("resuming %s: %d of %d items written\n", shard_options.output_file.c_str(),
+					shard_options.checkpoint->get_resumed(), shard_options.n);
+		}
+
+		BasicPipeline<E>* pipeline = new BasicPipeline<E>(shard_options);
+		if (!pipeline_file.empty()) {
+			if (!pipeline->load_file(pipeline_file))
+				return 1;
+		} else {
+			std::istringstream config(default_config);
+			if (!pipeline->load(config))
+				return 1;
+		}
+		pipelines.push_back(pipeline);
+	}
+
+	Telemetry* telemetry = nullptr;
+	if (!telemetry_file.empty()) {
+		telemetry = new Telemetry(telemetry_file, telemetry_period);
+		for (size_t i = 0; i < pipelines.size(); i++)
+			pipelines[i]->set_telemetry(telemetry, shards > 1 ? "shard" + std::to_string(i) + "_" : "");
+		if (options.transform_cache)
+			telemetry->add_cache("transform_cache", &options.transform_cache->get_stats());
+	}
+
+	for (BasicPipeline<E>* pipeline : pipelines)
+		pipeline->start();
+	if (telemetry)
+		telemetry->start();
+
+	for (BasicPipeline<E>* pipeline : pipelines)
+		pipeline->join();
+
+	for (BasicPipeline<E>* pipeline : pipelines)
+		if (OrderedQueue* ordered_queue = pipeline->get_ordered_queue())
+			ordered_queue->print_footprint(stdout);
+
+	// only a TS_QUEUE_PROFILE build (make profile) profiles the locks
+	for (size_t i = 0; i < pipelines.size(); i++)
+		pipelines[i]->print_lock_profile(stdout, shards > 1 ? "shard" + std::to_string(i) + "_" : "");
+
+	if (shards > 1) {
+		if (!merge_parts(parts, options.output_file, merge_order))
+			return 1;
+		for (std::string& part : parts)
+			unlink(part.c_str());
+	}
+
+	if (telemetry) {
+		telemetry->stop();
+		telemetry->print_summary(stdout);
+		delete telemetry;
+	}
+
+	// deletes the readers and the writers
+	for (BasicPipeline<E>* pipeline : pipelines)
+		delete pipeline;
+
+	return 0;
+}
+
+// the mode of "jump", "iterative" or "verify", false for anything else
+bool parse_transform_mode(std::string name, TransformMode* mode) {
+	if (name == "jump")
+		*mode = TRANSFORM_JUMP_AHEAD;
+	else if (name == "iterative")
+		*mode = TRANSFORM_ITERATIVE;
+	else if (name == "verify")
+		*mode = TRANSFORM_VERIFY;
+	else
+		return false;
+	return true;
+}
+
+// print why the value of --option is wrong, returns the exit status
+int unsupported(std::string option, std::string value, std::string expected) {
+	fprintf(stderr, "unsupported --%s %s, expected %s\n", option.c_str(), value.c_str(), expected.c_str());
+	return 1;
+}
+
+int usage(const char* program) {
+	fprintf(stderr, "usage: %s [--OPTION VALUE ...] N INPUT OUTPUT\n", program);
+	return 1;
+}
 
 int main(int argc, char** argv) {
-	assert(argc == 4);
-
-	int n = atoi(argv[1]);
-	std::string input_file_name(argv[2]);
-	std::string output_file_name(argv[3]);
-
-	// TODO: implements main function
-	TSQueue<Item*>* input_queue = new TSQueue<Item*>(READER_QUEUE_SIZE);
-	TSQueue<Item*>* worker_queue = new TSQueue<Item*>(WORKER_QUEUE_SIZE);
-	TSQueue<Item*>* output_queue = new TSQueue<Item*>(WRITER_QUEUE_SIZE);
-
-	Transformer* transformer = new Transformer;
-	Reader* reader = new Reader(n, input_file_name, input_queue);
-	Writer* writer = new Writer(n, output_file_name, output_queue);
-
-	Producer* p1 = new Producer(input_queue, worker_queue, transformer);
-	Producer* p2 = new Producer(input_queue, worker_queue, transformer);
-	Producer* p3 = new Producer(input_queue, worker_queue, transformer);
-	Producer* p4 = new Producer(input_queue, worker_queue, transformer);
-
-	ConsumerController* consumer_ctrler = new ConsumerController
-										(worker_queue, output_queue, transformer, 
-										CONSUMER_CONTROLLER_CHECK_PERIOD, 
-										(WORKER_QUEUE_SIZE * CONSUMER_CONTROLLER_LOW_THRESHOLD_PERCENTAGE / 100),
-										(WORKER_QUEUE_SIZE * CONSUMER_CONTROLLER_HIGH_THRESHOLD_PERCENTAGE / 100));
-
-	reader->start();
-	writer->start();
-
-	p1->start();
-	p2->start();
-	p3->start();
-	p4->start();
-	consumer_ctrler->start();
-
-	reader->join();
-	writer->join();
-
-	delete input_queue;
-	delete worker_queue;
-	delete output_queue;
-	delete reader;
-	delete writer;
-	delete transformer;
-	delete p1;
-	delete p2;
-	delete p3;
-	delete p4;
-	delete consumer_ctrler;
+	std::string input_queue_type(READER_QUEUE_TYPE);
+	std::string worker_queue_type(WORKER_QUEUE_TYPE);
+	std::string output_queue_type(WRITER_QUEUE_TYPE);
+	int reader_batch_size = READER_BATCH_SIZE;
+	int producer_batch_size = PRODUCER_BATCH_SIZE;
+	int consumer_batch_size = CONSUMER_BATCH_SIZE;
+	int writer_batch_size = WRITER_BATCH_SIZE;
+	std::string transform_mode(TRANSFORM_MODE);
+	std::string transform_isa(TRANSFORM_ISA);
+	std::string reader_mode(READER_MODE);
+	int parse_threads = READER_PARSE_THREADS;
+	std::string writer_mode(WRITER_MODE);
+	std::string scaling_policy(SCALING_POLICY);
+	int target_latency = TARGET_LATENCY;
+	int check_period = CONSUMER_CONTROLLER_CHECK_PERIOD;
+	bool scale_producers = false;
+	std::string telemetry_file;
+	int telemetry_period = TELEMETRY_PERIOD;
+	int input_queue_size = READER_QUEUE_SIZE;
+	int worker_queue_size = WORKER_QUEUE_SIZE;
+	int output_queue_size = WRITER_QUEUE_SIZE;
+	int num_producers = NUM_PRODUCERS;
+	int max_consumers = CONSUMER_CONTROLLER_MAX_CONSUMERS;
+	std::string pipeline_file;
+	bool by_value = false;
+	std::string layout(BATCH_LAYOUT);
+	int transform_cache_entries = TRANSFORM_CACHE_ENTRIES;
+	int shards = SHARDS;
+	std::string merge_order(MERGE_ORDER);
+	std::string placement_policy(PLACEMENT);
+	int checkpoint_period = CHECKPOINT_PERIOD;
+
+	static struct option long_options[] = {
+		{"input-queue", required_argument, 0, 'i'},
+		{"worker-queue", required_argument, 0, 'w'},
+		{"output-queue", required_argument, 0, 'o'},
+		{"reader-batch", required_argument, 0, 'R'},
+		{"producer-batch", required_argument, 0, 'P'},
+		{"consumer-batch", required_argument, 0, 'C'},
+		{"writer-batch", required_argument, 0, 'W'},
+		{"transform", required_argument, 0, 't'},
+		{"transform-isa", required_argument, 0, 'I'},
+		{"reader", required_argument, 0, 'r'},
+		{"parse-threads", required_argument, 0, 'p'},
+		{"writer", required_argument, 0, 'O'},
+		{"scaling", required_argument, 0, 's'},
+		{"target-latency", required_argument, 0, 'L'},
+		{"check-period", required_argument, 0, 'c'},
+		{"scale-producers", no_argument, 0, 'S'},
+		{"telemetry", required_argument, 0, 'T'},
+		{"telemetry-period", required_argument, 0, 'E'},
+		{"input-queue-size", required_argument, 0, 'a'},
+		{"worker-queue-size", required_argument, 0, 'b'},
+		{"output-queue-size", required_argument, 0, 'd'},
+		{"producers", required_argument, 0, 'n'},
+		{"max-consumers", required_argument, 0, 'm'},
+		{"pipeline", required_argument, 0, 'f'},
+		{"by-value", no_argument, 0, 'V'},
+		{"layout", required_argument, 0, 'y'},
+		{"transform-cache", required_argument, 0, 'M'},
+		{"shards", required_argument, 0, 'N'},
+		{"merge", required_argument, 0, 'g'},
+		{"placement", required_argument, 0, 'x'},
+		{"checkpoint", required_argument, 0, 'K'},
+		{0, 0, 0, 0}
+	};
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, "", long_options, nullptr)) != -1) {
+		switch (opt) {
+		case 'i':
+			input_queue_type = optarg;
+			break;
+		case 'w':
+			worker_queue_type = optarg;
+			break;
+		case 'o':
+			output_queue_type = optarg;
+			break;
+		case 'R':
+			reader_batch_size = atoi(optarg);
+			break;
+		case 'P':
+			producer_batch_size = atoi(optarg);
+			break;
+		case 'C':
+			consumer_batch_size = atoi(optarg);
+			break;
+		case 'W':
+			writer_batch_size = atoi(optarg);
+			break;
+		case 't':
+			transform_mode = optarg;
+			break;
+		case 'I':
+			transform_isa = optarg;
+			break;
+		case 'r':
+			reader_mode = optarg;
+			break;
+		case 'p':
+			parse_threads = atoi(optarg);
+			break;
+		case 'O':
+			writer_mode = optarg;
+			break;
+		case 's':
+			scaling_policy = optarg;
+			break;
+		case 'L':
+			target_latency = atoi(optarg);
+			break;
+		case 'c':
+			check_period = atoi(optarg);
+			break;
+		case 'S':
+			scale_producers = true;
+			break;
+		case 'T':
+			telemetry_file = optarg;
+			break;
+		case 'E':
+			telemetry_period = atoi(optarg);
+			break;
+		case 'a':
+			input_queue_size = atoi(optarg);
+			break;
+		case 'b':
+			worker_queue_size = atoi(optarg);
+			break;
+		case 'd':
+			output_queue_size = atoi(optarg);
+			break;
+		case 'n':
+			num_producers = atoi(optarg);
+			break;
+		case 'm':
+			max_consumers = atoi(optarg);
+			break;
+		case 'f':
+			pipeline_file = optarg;
+			break;
+		case 'V':
+			by_value = true;
+			break;
+		case 'y':
+			layout = optarg;
+			break;
+		case 'M':
+			transform_cache_entries = atoi(optarg);
+			break;
+		case 'N':
+			shards = atoi(optarg);
+			break;
+		case 'g':
+			merge_order = optarg;
+			break;
+		case 'x':
+			placement_policy = optarg;
+			break;
+		case 'K':
+			checkpoint_period = atoi(optarg);
+			break;
+		default:
+			return usage(argv[0]);
+		}
+	}
+	if (argc - optind != 3)
+		return usage(argv[0]);
+
+	// the options of a number, with the least value each can take
+	struct {
+		const char* option;
+		int value;
+		int least;
+	} numbers[] = {
+		{"reader-batch", reader_batch_size, 1},
+		{"producer-batch", producer_batch_size, 1},
+		{"consumer-batch", consumer_batch_size, 1},
+		{"writer-batch", writer_batch_size, 1},
+		{"parse-threads", parse_threads, 1},
+		{"target-latency", target_latency, 1},
+		{"check-period", check_period, 1},
+		{"telemetry-period", telemetry_period, 1},
+		{"input-queue-size", input_queue_size, 2},
+		{"worker-queue-size", worker_queue_size, 2},
+		{"output-queue-size", output_queue_size, 2},
+		{"producers", num_producers, 1},
+		{"max-consumers", max_consumers, 1},
+		{"transform-cache", transform_cache_entries, 0},
+		{"shards", shards, 1},
+		{"checkpoint", checkpoint_period, 0},
+	};
+	for (auto& number : numbers)
+		if (number.value < number.least)
+			return unsupported(number.option, std::to_string(number.value),
+				"at least " + std::to_string(number.least));
+
+	const char* queue_types = "ts, futex, lockfree, stealing, ordered or priority";
+	if (!is_queue_type(input_queue_type))
+		return unsupported("input-queue", input_queue_type, queue_types);
+	if (!is_queue_type(worker_queue_type))
+		return unsupported("worker-queue", worker_queue_type, queue_types);
+	if (!is_queue_type(output_queue_type))
+		return unsupported("output-queue", output_queue_type, queue_types);
+	TransformMode mode;
+	if (!parse_transform_mode(transform_mode, &mode))
+		return unsupported("transform", transform_mode, "jump, iterative or verify");
+	if (!Transformer::set_batch_isa(transform_isa.c_str()))
+		return unsupported("transform-isa", transform_isa, "auto, scalar, or avx2 or avx512 on a CPU that has it");
+	if (!is_scaling_policy(scaling_policy))
+		return unsupported("scaling", scaling_policy, "threshold, pid or latency");
+	if (layout != "aos" && layout != "soa")
+		return unsupported("layout", layout, "aos or soa");
+	if (merge_order != "arrival" && merge_order != "key")
+		return unsupported("merge", merge_order, "arrival or key");
+	PlacementPolicy placement;
+	if (!parse_placement(placement_policy, &placement))
+		return unsupported("placement", placement_policy, "none, llc or core");
+	ReaderMode reader;
+	if (!parse_reader_mode(reader_mode, &reader))
+		return unsupported("reader", reader_mode, "mmap, stream or binary");
+	WriterMode writer;
+	if (!parse_writer_mode(writer_mode, &writer))
+		return unsupported("writer", writer_mode, "buffered, stream, double or binary");
+
+	int n = atoi(argv[optind]);
+	std::string input_file_name(argv[optind + 1]);
+	std::string output_file_name(argv[optind + 2]);
+
+	ItemPool* item_pool = new ItemPool;
+	Transformer* transformer = new Transformer(mode);
+	TransformCache* transform_cache = nullptr;
+	if (transform_cache_entries > 0)
+		transform_cache = new TransformCache(transform_cache_entries);
+
+	PipelineOptions options;
+	options.n = n;
+	options.input_file = input_file_name;
+	options.output_file = output_file_name;
+	options.input_begin = 0;
+	options.input_end = SIZE_MAX;
+	options.first_key = 1;
+	options.transformer = transformer;
+	options.item_pool = item_pool;
+	options.transform_cache = transform_cache;
+	options.placement = nullptr;
+	if (placement != PLACEMENT_NONE)
+		options.placement = new Placement(placement, CpuTopology::detect());
+	options.checkpoint = nullptr;
+	options.checkpoint_period = checkpoint_period;
+	options.reader_mode = reader;
+	options.parse_threads = parse_threads;
+	options.writer_mode = writer;
+	options.check_period = check_period;
+	options.target_latency = target_latency;
+	options.low_threshold = CONSUMER_CONTROLLER_LOW_THRESHOLD_PERCENTAGE;
+	options.high_threshold = CONSUMER_CONTROLLER_HIGH_THRESHOLD_PERCENTAGE;
+
+	// every shard writes in key order for a merge by key
+	if (merge_order == "key")
+		output_queue_type = "ordered";
+
+	// with --scale-producers a controller scales the producers, num_producers of them working at first
+	int max_producers = std::max(num_producers, PRODUCER_CONTROLLER_MAX_PRODUCERS);
+	std::string default_config = default_pipeline(input_queue_type, input_queue_size,
+		worker_queue_type, worker_queue_size, output_queue_type, output_queue_size,
+		reader_batch_size, producer_batch_size, consumer_batch_size, writer_batch_size,
+		num_producers, scale_producers, max_producers, max_consumers, scaling_policy, layout);
+
+	MergeOrder order = merge_order == "key" ? MERGE_KEY : MERGE_ARRIVAL;
+	int status = by_value ?
+		run_pipelines<Item>(options, pipeline_file, default_config, telemetry_file, telemetry_period,
+			shards, order) :
+		run_pipelines<Item*>(options, pipeline_file, default_config, telemetry_file, telemetry_period,
+			shards, order);
+	if (status != 0)
+		return status;
+
+	if (transform_cache)
+		transform_cache->print_summary(stdout);
+
+	// every item has been written and given back by now
+	delete item_pool;
+
+	// The producers, the consumers and the controllers are still blocked on
+	// the queues. Destroying a condition variable that has waiters never
+	// returns on recent glibc, so the queues and everything that uses them
+	// are left for the process exit to reclaim.
 
 	return 0;
 }
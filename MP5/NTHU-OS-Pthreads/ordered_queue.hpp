@@ -0,0 +1,215 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <assert.h>
+#include <algorithm>
+#include "queue.hpp"
+#include "item.hpp"
+
+#ifndef ORDERED_QUEUE_HPP
+#define ORDERED_QUEUE_HPP
+
+// the key of the first item, the keys of the input are its line numbers
+#define ORDERED_QUEUE_FIRST_KEY 1
+
+// A reorder buffer in front of the Writer: the items can be enqueued in any
+// order, and are dequeued in key order. It holds a window of the next
+// window keys to dequeue, one slot per key, so it takes window pointers
+// however far the items are out of order.
+//
+// An item past the window waits in enqueue until the window reaches it. The
+// thread holding the next key could then be stuck behind it upstream, so the
+// Reader waits in admit before letting an item into the pipeline instead:
+// with at most window items past the next key in flight, every enqueue fits
+// at once and the backpressure of a full window reaches the producers as an
+// input queue that stops filling.
+//
+// The keys have to be exactly first_key, first_key + 1, ..., each once, and
+// reach admit in that order: a missing key would hold the window forever and
+// a repeated one would take the slot of another. The Reader checks its keys
+// against get_first_key as it reads them and stops the run at the first one
+// out of sequence, so the asserts here are never hit by a bad input.
+class OrderedQueue : public Queue<Item*> {
+public:
+	// constructor
+	explicit OrderedQueue(int window, int first_key = ORDERED_QUEUE_FIRST_KEY);
+
+	// destructor
+	~OrderedQueue();
+
+	// put an item in the slot of its key
+	virtual void enqueue(Item* item) override;
+
+	// remove and return the item with the next key
+	virtual Item* dequeue() override;
+
+	// put n items in their slots under one lock round-trip,
+	// the items past the window are moved to the front of items while they wait
+	virtual void enqueue_bulk(Item** items, int n) override;
+
+	// remove up to max items with consecutive keys from the next one on
+	virtual int dequeue_bulk(Item** items, int max, const std::atomic<bool>* cancel = nullptr) override;
+
+	// wake the threads blocked in dequeue_bulk
+	virtual void wake_dequeuers() override;
+
+	// return the number of items held
+	virtual int get_size() override;
+
+	// wait until key is in the window, return the first key past the window
+	// then, so the keys below it need not wait again
+	int admit(int key);
+
+	// print the memory the buffer takes: the slots and the most items held at once
+	void print_footprint(FILE* out);
+
+	// the key the buffer starts at
+	int get_first_key();
+private:
+	// the number of slots, the slot of a key is (key - first_key) % window
+	int window;
+	int first_key;
+	Item** slots;
+
+	// the key of the item to dequeue next
+	int next;
+	// the number of items held, and the most ever held
+	int size;
+	int max_size;
+
+	pthread_mutex_t mutex;
+	// cond_enqueue is waited on by enqueue and admit, for the window to move
+	pthread_cond_t cond_enqueue, cond_dequeue;
+
+	Item*& slot(int key);
+};
+
+// Implementation start
+
+OrderedQueue::OrderedQueue(int window, int first_key)
+	: window(window), first_key(first_key), next(first_key), size(0), max_size(0) {
+	slots = new Item*[window];
+	std::fill(slots, slots + window, nullptr);
+
+	pthread_mutex_init(&mutex, nullptr);
+	pthread_cond_init(&cond_enqueue, nullptr);
+	pthread_cond_init(&cond_dequeue, nullptr);
+}
+
+OrderedQueue::~OrderedQueue() {
+	delete[] slots;
+
+	pthread_mutex_destroy(&mutex);
+	pthread_cond_destroy(&cond_enqueue);
+	pthread_cond_destroy(&cond_dequeue);
+}
+
+Item*& OrderedQueue::slot(int key) {
+	return slots[(key - first_key) % window];
+}
+
+void OrderedQueue::enqueue(Item* item) {
+	enqueue_bulk(&item, 1);
+}
+
+Item* OrderedQueue::dequeue() {
+	Item* item;
+	dequeue_bulk(&item, 1);
+	return item;
+}
+
+void OrderedQueue::enqueue_bulk(Item** items, int n) {
+	pthread_mutex_lock(&mutex);
+
+	while (n > 0) {
+		// every item in the window goes in, the others are kept for the next round,
+		// so an item of the next key is never held back by one past the window
+		int count = 0, kept = 0;
+		for (int i = 0; i < n; i++) {
+			int key = items[i]->key;
+			assert(key >= next && "an item with a key already dequeued");
+			if (key - next >= window) {
+				items[kept++] = items[i];
+				continue;
+			}
+			assert(!slot(key) && "two items with the same key");
+			slot(key) = items[i];
+			count++;
+		}
+		size += count;
+		max_size = std::max(max_size, size);
+		n = kept;
+		if (this->stats && count > 0)
+			this->stats->record_enqueue(count, size);
+
+		if (slot(next))
+			pthread_cond_broadcast(&cond_dequeue);
+		if (n > 0)
+			this->wait(&cond_enqueue, &mutex, true);
+	}
+
+	pthread_mutex_unlock(&mutex);
+}
+
+int OrderedQueue::dequeue_bulk(Item** items, int max, const std::atomic<bool>* cancel) {
+	pthread_mutex_lock(&mutex);
+
+	while (!slot(next)) {
+		// checked under the lock wake_dequeuers takes, so a wake-up is never missed
+		if (cancel && cancel->load()) {
+			pthread_mutex_unlock(&mutex);
+			return 0;
+		}
+		this->wait(&cond_dequeue, &mutex, false);
+	}
+
+	int count = 0;
+	while (count < max && slot(next)) {
+		items[count++] = slot(next);
+		slot(next) = nullptr;
+		next++;
+	}
+	size -= count;
+	if (this->stats)
+		this->stats->record_dequeue(count, size);
+
+	// the window moved on, for the enqueuers and the Reader in admit
+	pthread_cond_broadcast(&cond_enqueue);
+
+	pthread_mutex_unlock(&mutex);
+
+	return count;
+}
+
+void OrderedQueue::wake_dequeuers() {
+	pthread_mutex_lock(&mutex);
+	pthread_cond_broadcast(&cond_dequeue);
+	pthread_mutex_unlock(&mutex);
+}
+
+int OrderedQueue::get_size() {
+	return size;
+}
+
+int OrderedQueue::admit(int key) {
+	pthread_mutex_lock(&mutex);
+	while (key - next >= window) {
+		this->wait(&cond_enqueue, &mutex, true);
+	}
+	int end = next + window;
+	pthread_mutex_unlock(&mutex);
+
+	return end;
+}
+
+int OrderedQueue::get_first_key() {
+	return first_key;
+}
+
+void OrderedQueue::print_footprint(FILE* out) {
+	pthread_mutex_lock(&mutex);
+	fprintf(out, "ordered output: a window of %d keys, %zu bytes of slots, at most %d items held (%zu bytes)\n",
+		window, window * sizeof(Item*), max_size, max_size * sizeof(Item));
+	pthread_mutex_unlock(&mutex);
+}
+
+#endif // ORDERED_QUEUE_HPP
@@ -0,0 +1,693 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include "queue.hpp"
+#include "ts_queue.hpp"
+#include "lf_queue.hpp"
+#include "ws_queue.hpp"
+#include "ordered_queue.hpp"
+#include "cost_queue.hpp"
+#include "item.hpp"
+#include "transformer.hpp"
+#include "stage.hpp"
+#include "reader.hpp"
+#include "writer.hpp"
+#include "producer.hpp"
+#include "consumer.hpp"
+#include "router.hpp"
+#include "consumer_controller.hpp"
+#include "producer_controller.hpp"
+#include "scaling_policy.hpp"
+#include "telemetry.hpp"
+#include "transform_cache.hpp"
+#include "topology.hpp"
+
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+// the pool size of a scaled stage without a max
+#define PIPELINE_DEFAULT_MAX_THREADS 16
+
+// whether type names a queue make_queue makes
+bool is_queue_type(std::string type) {
+	return type == "ts" || type == "futex" || type == "lockfree" || type == "stealing" || type == "ordered" ||
+		type == "priority";
+}
+
+// the queues of items by value, nullptr for the types only taking items
+// by pointer: stealing needs an atomic element, ordered and priority
+// are queues of Item*
+template <class E>
+Queue<E>* make_value_queue(std::string type, int size) {
+	if (type == "lockfree")
+		return new LFQueue<E>(size);
+	if (type == "futex")
+		return new TSQueue<E, SpinFutexWaitPolicy>(size);
+	if (type == "ts")
+		return new TSQueue<E>(size);
+	return nullptr;
+}
+
+// a queue of a type is_queue_type accepts,
+// deques is the number of dequeuing threads of a "stealing" queue,
+// spec the TransformSpec of the stage dequeuing from a "priority" queue
+Queue<Item*>* make_queue(std::string type, int size, int deques,
+	const TransformSpec* (*spec)(char opcode) = nullptr) {
+	if (type == "stealing")
+		return new WSQueue<Item*>(size, deques);
+	if (type == "ordered")
+		return new OrderedQueue(size);
+	if (type == "priority")
+		return new CostQueue(size, spec);
+
+	Queue<Item*>* queue = make_value_queue<Item*>(type, size);
+	assert(queue);
+	return queue;
+}
+
+// the mode of "mmap", "stream" or "binary", false for anything else
+bool parse_reader_mode(std::string name, ReaderMode* mode) {
+	if (name == "mmap")
+		*mode = READER_MMAP;
+	else if (name == "stream")
+		*mode = READER_STREAM;
+	else if (name == "binary")
+		*mode = READER_BINARY;
+	else
+		return false;
+	return true;
+}
+
+// the mode of "buffered", "stream", "double" or "binary", false for anything else
+bool parse_writer_mode(std::string name, WriterMode* mode) {
+	if (name == "buffered")
+		*mode = WRITER_BUFFERED;
+	else if (name == "stream")
+		*mode = WRITER_STREAM;
+	else if (name == "double")
+		*mode = WRITER_DOUBLE_BUFFERED;
+	else if (name == "binary")
+		*mode = WRITER_BINARY;
+	else
+		return false;
+	return true;
+}
+
+// whether kind names a policy make_policy makes
+bool is_scaling_policy(std::string kind) {
+	return kind == "threshold" || kind == "pid" || kind == "latency";
+}
+
+// a new policy of a kind is_scaling_policy accepts, for a stage taking
+// items from a queue of the given capacity,
+// the thresholds of "threshold" are percentages of the capacity
+ScalingPolicy* make_policy(std::string kind, int capacity, double target_latency,
+	int low_threshold, int high_threshold) {
+	if (kind == "pid")
+		return new PIDPolicy(capacity);
+	if (kind == "latency")
+		return new TargetLatencyPolicy(target_latency);
+
+	assert(kind == "threshold");
+	return new ThresholdPolicy(capacity * low_threshold / 100, capacity * high_threshold / 100);
+}
+
+// what the config of a Pipeline leaves to the command line
+struct PipelineOptions {
+	// the number of items, where they are read from and written to
+	int n;
+	std::string input_file;
+	std::string output_file;
+	// the bytes of the input file to read, 0 and SIZE_MAX for all of it, and
+	// the key of their first item, where an ordered queue starts
+	size_t input_begin;
+	size_t input_end;
+	int first_key;
+
+	Transformer* transformer;
+	ItemPool* item_pool;
+	// shared by every producer and consumer, nullptr without one
+	TransformCache* transform_cache;
+	// where the threads run, nullptr for wherever the kernel puts them
+	Placement* placement;
+	// what the run resumes from and records its progress in, saved every
+	// checkpoint_period items, nullptr without one
+	Checkpoint* checkpoint;
+	int checkpoint_period;
+
+	// the reader and the writer without a mode or parse key
+	ReaderMode reader_mode;
+	int parse_threads;
+	WriterMode writer_mode;
+
+	// the scaled stages: the check period and the target latency of "latency"
+	// in microseconds, the thresholds of "threshold" in percent of the capacity
+	int check_period;
+	int target_latency;
+	int low_threshold;
+	int high_threshold;
+};
+
+// Queues and stages wired up from a config, one declaration per line,
+// "#" starts a comment:
+//
+//   queue NAME TYPE CAPACITY
+//     a queue of items, TYPE is "ts", "futex" (a TSQueue spinning, then
+//     sleeping on a futex), "lockfree", "stealing", "ordered"
+//     (an OrderedQueue of a window of CAPACITY keys, at most one of them)
+//     or "priority" (a CostQueue, by the costs of the stage taking from it)
+//     (only ts, futex and lockfree carry items by value)
+//   stage KIND FROM TO [KEY=VALUE ...]
+//     threads of KIND taking the items of queue FROM and giving them to queue TO
+//
+// KIND is "reader" (FROM is "-"), "writer" (TO is "-"), "producer", "consumer"
+// or "split". The TO of a split is a list of QUEUE:OPCODES routes separated by
+// commas, "*" standing for every other opcode, e.g. "fast:AB,slow:*".
+//
+// The keys are threads (1 by default), batch (the batch size, 1 by default),
+// scale (a scaling policy, "threshold", "pid" or "latency", which puts a
+// producer or consumer stage under a controller: the producers start with
+// threads of them working, the consumers with none), max (the pool size of a
+// scaled stage), mode (the ReaderMode "mmap", "stream" or "binary", or the
+// WriterMode "stream", "buffered", "double" or "binary"), parse (the parse threads of a reader) and
+// layout (how a producer or consumer stage transforms a batch, "aos" with an
+// OpcodeBatcher by default or "soa" as an ItemBatch).
+//
+// There is one reader and one writer. Stages sharing a FROM compete for its
+// items and stages sharing a TO merge into it, so fan-out and fan-in need no
+// stage of their own. Every item has to meet exactly one producer and one
+// consumer stage on its way from the reader to the writer.
+//
+// E is how the queues carry the items: Item* (a Pipeline) moves pointers to
+// the Items of the pool, Item moves the 16 bytes of every Item through the
+// queues instead, with no pool and no pointer to follow at every stage.
+template <class E>
+class BasicPipeline {
+public:
+	// constructor
+	BasicPipeline(PipelineOptions options);
+
+	// destructor, see main for what is left behind
+	~BasicPipeline();
+
+	// build the pipeline of a config, returns false and prints why if it is wrong
+	bool load(std::istream& config);
+	bool load_file(std::string config_file);
+
+	// sample the queues and the threads into telemetry, before start,
+	// with their names starting with prefix
+	void set_telemetry(Telemetry* telemetry, std::string prefix = "");
+
+	// start every stage and controller
+	void start();
+
+	// wait for the writer to have written every item
+	void join();
+
+	// the queue of type "ordered", nullptr without one
+	OrderedQueue* get_ordered_queue();
+
+	// print the lock profile of every queue that kept one, after join,
+	// named like the queues of the telemetry
+	void print_lock_profile(FILE* out, std::string prefix = "");
+private:
+	struct PipelineQueue {
+		std::string name;
+		std::string type;
+		int capacity;
+		Queue<E>* queue;
+		QueueStats stats;
+		// kept by the TSQueues of a TS_QUEUE_PROFILE build
+		LockProfile profile;
+		bool profiled;
+	};
+
+	struct PipelineStage {
+		std::string kind;
+		std::string from;
+		std::string to;
+		int threads;
+		int batch;
+		std::string scale;
+		int max;
+		std::string mode;
+		int parse;
+		bool soa;
+
+		// the threads of an unscaled stage, or the controller of a scaled one
+		std::vector<Stage<E, E>*> stages;
+		BasicProducerController<E>* producer_ctrler;
+		BasicConsumerController<E>* consumer_ctrler;
+	};
+
+	PipelineOptions options;
+
+	std::vector<PipelineQueue*> queues;
+	std::vector<PipelineStage*> stages;
+
+	BasicReader<E>* reader;
+	BasicWriter<E>* writer;
+	Telemetry* telemetry;
+	std::string telemetry_prefix;
+	// when each item was read, for the latency of the telemetry
+	ReadTimes* read_times;
+	OrderedQueue* ordered_queue;
+
+	PipelineQueue* find_queue(std::string name);
+
+	// a queue of the given type, nullptr if it does not take an E
+	Queue<E>* new_queue(std::string type, int size, int deques,
+		const TransformSpec* (*spec)(char opcode));
+
+	// parse a line of the config into queues or stages, false if it is wrong
+	bool parse_line(std::string line);
+
+	// check the declarations, create the queues and the stages
+	bool build();
+};
+
+typedef BasicPipeline<Item*> Pipeline;
+
+// Implementation start
+
+template <class E>
+BasicPipeline<E>::BasicPipeline(PipelineOptions options)
+	: options(options), reader(nullptr), writer(nullptr), telemetry(nullptr), read_times(nullptr),
+	ordered_queue(nullptr) {
+}
+
+template <class E>
+BasicPipeline<E>::~BasicPipeline() {
+	delete reader;
+	delete writer;
+	delete read_times;
+}
+
+template <class E>
+Queue<E>* BasicPipeline<E>::new_queue(std::string type, int size, int,
+	const TransformSpec* (*)(char opcode)) {
+	return make_value_queue<E>(type, size);
+}
+
+template <>
+inline Queue<Item*>* BasicPipeline<Item*>::new_queue(std::string type, int size, int deques,
+	const TransformSpec* (*spec)(char opcode)) {
+	if (type == "ordered") {
+		ordered_queue = new OrderedQueue(size,
+			options.checkpoint ? options.checkpoint->get_resume_key() : options.first_key);
+		return ordered_queue;
+	}
+	return make_queue(type, size, deques, spec);
+}
+
+template <class E>
+typename BasicPipeline<E>::PipelineQueue* BasicPipeline<E>::find_queue(std::string name) {
+	for (PipelineQueue* queue : queues)
+		if (queue->name == name)
+			return queue;
+	return nullptr;
+}
+
+template <class E>
+bool BasicPipeline<E>::parse_line(std::string line) {
+	line = line.substr(0, line.find('#'));
+	std::istringstream words(line);
+	std::string declaration;
+	if (!(words >> declaration))
+		return true;
+
+	if (declaration == "queue") {
+		PipelineQueue* queue = new PipelineQueue;
+		queue->queue = nullptr;
+		queue->profiled = false;
+		if (!(words >> queue->name >> queue->type >> queue->capacity) || queue->capacity < 2 ||
+			!is_queue_type(queue->type)) {
+			delete queue;
+			return false;
+		}
+		queues.push_back(queue);
+		return true;
+	}
+
+	if (declaration != "stage")
+		return false;
+
+	PipelineStage* stage = new PipelineStage;
+	stage->threads = 1;
+	stage->batch = 1;
+	stage->max = 0;
+	stage->parse = options.parse_threads;
+	stage->soa = false;
+	stage->producer_ctrler = nullptr;
+	stage->consumer_ctrler = nullptr;
+	stages.push_back(stage);
+	if (!(words >> stage->kind >> stage->from >> stage->to))
+		return false;
+
+	std::string option;
+	while (words >> option) {
+		size_t equal = option.find('=');
+		if (equal == std::string::npos)
+			return false;
+		std::string key = option.substr(0, equal);
+		std::string value = option.substr(equal + 1);
+
+		if (key == "threads")
+			stage->threads = atoi(value.c_str());
+		else if (key == "batch")
+			stage->batch = atoi(value.c_str());
+		else if (key == "max")
+			stage->max = atoi(value.c_str());
+		else if (key == "parse")
+			stage->parse = atoi(value.c_str());
+		else if (key == "scale" && is_scaling_policy(value))
+			stage->scale = value;
+		else if (key == "mode")
+			stage->mode = value;
+		else if (key == "layout" && (value == "aos" || value == "soa"))
+			stage->soa = value == "soa";
+		else
+			return false;
+	}
+
+	// only the reader and the writer have a mode, each of its own
+	if (!stage->mode.empty()) {
+		ReaderMode reader_mode;
+		WriterMode writer_mode;
+		bool known = stage->kind == "reader" ? parse_reader_mode(stage->mode, &reader_mode) :
+			stage->kind == "writer" && parse_writer_mode(stage->mode, &writer_mode);
+		if (!known)
+			return false;
+	}
+	return stage->threads > 0 && stage->batch > 0 && stage->max >= 0 && stage->parse > 0;
+}
+
+template <class E>
+bool BasicPipeline<E>::load(std::istream& config) {
+	std::string line;
+	for (int number = 1; std::getline(config, line); number++) {
+		if (!parse_line(line)) {
+			fprintf(stderr, "pipeline config line %d is wrong: %s\n", number, line.c_str());
+			return false;
+		}
+	}
+	return build();
+}
+
+template <class E>
+bool BasicPipeline<E>::load_file(std::string config_file) {
+	std::ifstream config(config_file);
+	if (!config) {
+		fprintf(stderr, "cannot open the pipeline config %s\n", config_file.c_str());
+		return false;
+	}
+	return load(config);
+}
+
+template <class E>
+bool BasicPipeline<E>::build() {
+	// the queues each stage takes from and gives to, and the number of threads
+	// dequeuing from each queue, the deques of a "stealing" one
+	std::vector<std::vector<std::pair<PipelineQueue*, std::string> > > outputs(stages.size());
+	std::vector<int> dequeuers(queues.size(), 0), enqueuers(queues.size(), 0);
+	// the kind of the stages dequeuing from each queue, "" if they differ
+	std::vector<std::string> dequeuer_kinds(queues.size());
+	int readers = 0, writers = 0;
+
+	for (size_t i = 0; i < stages.size(); i++) {
+		PipelineStage* stage = stages[i];
+		bool scaled = !stage->scale.empty();
+		if (scaled && stage->max == 0)
+			stage->max = std::max(stage->threads, PIPELINE_DEFAULT_MAX_THREADS);
+
+		if (stage->kind == "reader")
+			readers++;
+		else if (stage->kind == "writer")
+			writers++;
+		else if (stage->kind != "producer" && stage->kind != "consumer" && stage->kind != "split") {
+			fprintf(stderr, "unknown pipeline stage %s\n", stage->kind.c_str());
+			return false;
+		}
+		if (scaled && stage->kind != "producer" && stage->kind != "consumer") {
+			fprintf(stderr, "only producer and consumer stages scale, not %s\n", stage->kind.c_str());
+			return false;
+		}
+		if (stage->soa && stage->kind != "producer" && stage->kind != "consumer") {
+			fprintf(stderr, "only producer and consumer stages have a layout, not %s\n", stage->kind.c_str());
+			return false;
+		}
+		if ((stage->kind == "reader" || stage->kind == "writer") && stage->threads != 1) {
+			fprintf(stderr, "the %s stage has one thread\n", stage->kind.c_str());
+			return false;
+		}
+
+		if (stage->kind != "reader") {
+			PipelineQueue* from = find_queue(stage->from);
+			if (!from) {
+				fprintf(stderr, "the %s stage takes from an unknown queue %s\n",
+					stage->kind.c_str(), stage->from.c_str());
+				return false;
+			}
+			size_t q = std::find(queues.begin(), queues.end(), from) - queues.begin();
+			dequeuer_kinds[q] = dequeuers[q] && dequeuer_kinds[q] != stage->kind ? "" : stage->kind;
+			dequeuers[q] += scaled ? stage->max : stage->threads;
+		}
+
+		if (stage->kind == "writer")
+			continue;
+
+		// the routes of a split, the single queue of the others
+		std::string routes = stage->to + ",";
+		for (size_t begin = 0, end; (end = routes.find(',', begin)) != std::string::npos; begin = end + 1) {
+			std::string route = routes.substr(begin, end - begin);
+			size_t colon = route.find(':');
+			std::string name = stage->kind == "split" ? route.substr(0, colon) : route;
+			std::string opcodes = stage->kind == "split" && colon != std::string::npos ? route.substr(colon + 1) : "";
+			if (stage->kind == "split" ? opcodes.empty() : stage->to.find(',') != std::string::npos) {
+				fprintf(stderr, "the %s stage has a wrong destination %s\n", stage->kind.c_str(), stage->to.c_str());
+				return false;
+			}
+
+			PipelineQueue* to = find_queue(name);
+			if (!to) {
+				fprintf(stderr, "the %s stage gives to an unknown queue %s\n", stage->kind.c_str(), name.c_str());
+				return false;
+			}
+			outputs[i].push_back(std::make_pair(to, opcodes));
+			enqueuers[std::find(queues.begin(), queues.end(), to) - queues.begin()]++;
+		}
+	}
+
+	if (readers != 1 || writers != 1) {
+		fprintf(stderr, "a pipeline has one reader and one writer stage\n");
+		return false;
+	}
+	for (size_t q = 0; q < queues.size(); q++) {
+		if (!dequeuers[q] || !enqueuers[q]) {
+			fprintf(stderr, "nothing %s queue %s\n", dequeuers[q] ? "gives to" : "takes from",
+				queues[q]->name.c_str());
+			return false;
+		}
+	}
+
+	if (std::count_if(queues.begin(), queues.end(),
+		[](PipelineQueue* queue) { return queue->type == "ordered"; }) > 1) {
+		fprintf(stderr, "a pipeline has at most one ordered queue\n");
+		return false;
+	}
+	// an ordered queue waits for every key from the first one not written
+	Checkpoint* checkpoint = options.checkpoint;
+	if (checkpoint && checkpoint->get_resumed() != checkpoint->get_resume_key() - options.first_key &&
+		std::count_if(queues.begin(), queues.end(), [](PipelineQueue* queue) { return queue->type == "ordered"; })) {
+		fprintf(stderr, "the checkpoint is of a run out of key order, it resumes without an ordered queue\n");
+		return false;
+	}
+
+	for (size_t q = 0; q < queues.size(); q++) {
+		const TransformSpec* (*spec)(char opcode) = nullptr;
+		if (dequeuer_kinds[q] == "producer")
+			spec = Transformer::producer_spec;
+		else if (dequeuer_kinds[q] == "consumer")
+			spec = Transformer::consumer_spec;
+		queues[q]->queue = new_queue(queues[q]->type, queues[q]->capacity, dequeuers[q], spec);
+		if (!queues[q]->queue) {
+			fprintf(stderr, "queue %s: the %s type does not carry items by value\n",
+				queues[q]->name.c_str(), queues[q]->type.c_str());
+			return false;
+		}
+	}
+
+	for (size_t i = 0; i < stages.size(); i++) {
+		PipelineStage* stage = stages[i];
+		PipelineQueue* from = find_queue(stage->from);
+		Queue<E>* to = outputs[i].empty() ? nullptr : outputs[i][0].first->queue;
+
+		if (stage->kind == "reader") {
+			ReaderMode mode = options.reader_mode;
+			if (!stage->mode.empty())
+				parse_reader_mode(stage->mode, &mode);
+			reader = new BasicReader<E>(options.n, options.input_file, to, stage->batch, options.item_pool,
+				mode, stage->parse);
+			reader->set_range(options.input_begin, options.input_end);
+			reader->set_window(ordered_queue);
+			if (checkpoint)
+				reader->set_checkpoint(checkpoint);
+			stage->stages.push_back(reader);
+		} else if (stage->kind == "writer") {
+			WriterMode mode = options.writer_mode;
+			if (!stage->mode.empty())
+				parse_writer_mode(stage->mode, &mode);
+			if (checkpoint && mode == WRITER_STREAM) {
+				fprintf(stderr, "a checkpoint needs a buffered writer, not stream\n");
+				return false;
+			}
+			writer = new BasicWriter<E>(options.n, options.output_file, from->queue, stage->batch, options.item_pool,
+				mode);
+			if (checkpoint)
+				writer->set_checkpoint(checkpoint, options.checkpoint_period);
+			stage->stages.push_back(writer);
+		} else if (stage->kind == "split") {
+			for (int t = 0; t < stage->threads; t++) {
+				BasicRouter<E>* router = new BasicRouter<E>(from->queue, stage->batch);
+				for (std::pair<PipelineQueue*, std::string>& route : outputs[i])
+					router->add_route(route.second, route.first->queue);
+				stage->stages.push_back(router);
+			}
+		} else if (!stage->scale.empty()) {
+			ScalingPolicy* policy = make_policy(stage->scale, from->capacity, options.target_latency / 1e6,
+				options.low_threshold, options.high_threshold);
+			if (stage->kind == "producer") {
+				stage->producer_ctrler = new BasicProducerController<E>(from->queue, to, options.transformer,
+					options.check_period, policy, stage->threads, stage->max, stage->batch, stage->soa);
+				stage->producer_ctrler->set_cache(options.transform_cache);
+			} else {
+				stage->consumer_ctrler = new BasicConsumerController<E>(from->queue, to, options.transformer,
+					options.check_period,
+					from->capacity * options.low_threshold / 100,
+					from->capacity * options.high_threshold / 100,
+					stage->batch, stage->max, policy, stage->soa);
+				stage->consumer_ctrler->set_cache(options.transform_cache);
+			}
+		} else {
+			for (int t = 0; t < stage->threads; t++) {
+				if (stage->kind == "producer") {
+					BasicProducer<E>* producer = new BasicProducer<E>(from->queue, to, options.transformer,
+						stage->batch, stage->soa);
+					producer->set_cache(options.transform_cache);
+					stage->stages.push_back(producer);
+				} else {
+					BasicConsumer<E>* consumer = new BasicConsumer<E>(from->queue, to, options.transformer,
+						stage->batch, stage->soa);
+					consumer->set_cache(options.transform_cache);
+					stage->stages.push_back(consumer);
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+template <class E>
+void BasicPipeline<E>::set_telemetry(Telemetry* telemetry, std::string prefix) {
+	this->telemetry = telemetry;
+	this->telemetry_prefix = prefix;
+}
+
+template <class E>
+void BasicPipeline<E>::start() {
+	if (telemetry) {
+		for (PipelineQueue* queue : queues)
+			queue->queue->set_stats(&queue->stats);
+		// the keys of the input are its line numbers
+		read_times = new ReadTimes(options.first_key + options.n);
+		reader->set_read_times(read_times);
+		writer->set_latency(telemetry->get_latency(), read_times);
+	}
+
+	for (PipelineQueue* queue : queues)
+		queue->profiled = queue->queue->set_profile(&queue->profile);
+
+	// the stages take the CPUs of the domain in the order of the config, the
+	// reader one for each parse thread, which run where the reader does
+	if (options.placement) {
+		int domain = options.placement->claim_domain();
+		for (PipelineStage* stage : stages) {
+			for (Stage<E, E>* thread : stage->stages)
+				options.placement->place(thread, domain, stage->kind == "reader" ? std::max(stage->parse, 1) : 1);
+			if (stage->producer_ctrler)
+				stage->producer_ctrler->set_placement(options.placement, domain);
+			if (stage->consumer_ctrler)
+				stage->consumer_ctrler->set_placement(options.placement, domain);
+		}
+	}
+
+	for (PipelineStage* stage : stages) {
+		for (Stage<E, E>* thread : stage->stages)
+			thread->start();
+		if (stage->producer_ctrler)
+			stage->producer_ctrler->start();
+		if (stage->consumer_ctrler)
+			stage->consumer_ctrler->start();
+	}
+
+	if (!telemetry)
+		return;
+
+	for (PipelineQueue* queue : queues)
+		telemetry->add_queue(telemetry_prefix + queue->name + "_queue", &queue->stats);
+
+	// the threads are named after their kind, numbered across the stages of
+	// that kind but for the reader and the writer,
+	// and the pools are complete once the controllers have started
+	std::vector<std::string> kinds;
+	std::vector<int> counts;
+	for (PipelineStage* stage : stages) {
+		std::vector<ServiceStats*> stats;
+		for (Stage<E, E>* thread : stage->stages)
+			stats.push_back(&thread->get_stats());
+		if (stage->producer_ctrler)
+			stats = stage->producer_ctrler->get_stats();
+		if (stage->consumer_ctrler)
+			stats = stage->consumer_ctrler->get_stats();
+
+		if (stage->kind == "reader" || stage->kind == "writer") {
+			telemetry->add_thread(telemetry_prefix + stage->kind, stats[0]);
+			continue;
+		}
+
+		size_t kind = std::find(kinds.begin(), kinds.end(), stage->kind) - kinds.begin();
+		if (kind == kinds.size()) {
+			kinds.push_back(stage->kind);
+			counts.push_back(0);
+		}
+		for (ServiceStats* thread_stats : stats)
+			telemetry->add_thread(telemetry_prefix + stage->kind + std::to_string(counts[kind]++), thread_stats);
+	}
+}
+
+template <class E>
+void BasicPipeline<E>::join() {
+	reader->join();
+	writer->join();
+}
+
+template <class E>
+OrderedQueue* BasicPipeline<E>::get_ordered_queue() {
+	return ordered_queue;
+}
+
+template <class E>
+void BasicPipeline<E>::print_lock_profile(FILE* out, std::string prefix) {
+	for (PipelineQueue* queue : queues)
+		if (queue->profiled)
+			queue->profile.print(out, prefix + queue->name + "_queue");
+}
+
+#endif // PIPELINE_HPP
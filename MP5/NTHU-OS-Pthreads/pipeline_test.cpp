@@ -0,0 +1,87 @@
+#include <assert.h>
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include "pipeline.hpp"
+
+// the lines of file with a key from first to last, sorted
+std::vector<std::string> read_sorted(std::string file, int first, int last) {
+	std::ifstream in(file);
+	assert(in);
+	std::vector<std::string> lines;
+	std::string line;
+	while (std::getline(in, line)) {
+		int key;
+		if (std::istringstream(line) >> key && key >= first && key <= last)
+			lines.push_back(line);
+	}
+	std::sort(lines.begin(), lines.end());
+	return lines;
+}
+
+// a config naming an unknown queue type, scaling policy or mode is
+// refused, not run
+void test_wrong_config(PipelineOptions options) {
+	const char* wrong[] = {
+		"queue input bogus 200\n",
+		"queue input ts 200\nstage producer input output scale=bogus\n",
+		"queue input ts 200\nstage reader - input mode=bogus\n",
+		"queue output ts 200\nstage writer output - mode=mmap\n",
+		"queue input ts 200\nstage producer input output mode=stream\n",
+	};
+	for (const char* config : wrong) {
+		Pipeline pipeline(options);
+		std::istringstream in(config);
+		assert(!pipeline.load(in));
+	}
+}
+
+int main() {
+	ItemPool* item_pool = new ItemPool;
+	Transformer* transformer = new Transformer;
+
+	PipelineOptions options;
+	// the C and D items of the first 800 lines take the heavy route,
+	// the B and E ones after them the light route
+	options.n = 1000;
+	options.input_file = "./tests/01.in";
+	options.output_file = "./tests/01.out";
+	options.input_begin = 0;
+	options.input_end = SIZE_MAX;
+	options.first_key = 1;
+	options.transformer = transformer;
+	options.item_pool = item_pool;
+	options.transform_cache = nullptr;
+	options.placement = nullptr;
+	options.checkpoint = nullptr;
+	options.checkpoint_period = 0;
+	options.reader_mode = READER_MMAP;
+	options.parse_threads = 1;
+	options.writer_mode = WRITER_BUFFERED;
+	options.check_period = 10000;
+	options.target_latency = 10000;
+	options.low_threshold = 20;
+	options.high_threshold = 80;
+
+	test_wrong_config(options);
+
+	Pipeline* pipeline = new Pipeline(options);
+	if (!pipeline->load_file("./pipelines/split_by_opcode.conf"))
+		return 1;
+
+	pipeline->start();
+	pipeline->join();
+
+	// every item routed by its opcode and transformed into the expected one
+	std::vector<std::string> output = read_sorted(options.output_file, INT_MIN, INT_MAX);
+	std::vector<std::string> expected = read_sorted("./tests/01.ans", 1, options.n);
+	printf("%zu of %zu lines as expected\n", output.size(), expected.size());
+	assert((int)expected.size() == options.n);
+	assert(output == expected);
+
+	delete pipeline;
+	delete item_pool;
+
+	return 0;
+}
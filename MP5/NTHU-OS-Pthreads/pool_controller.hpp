@@ -0,0 +1,293 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "thread.hpp"
+#include "queue.hpp"
+#include "item.hpp"
+#include "transformer.hpp"
+#include "transform_cache.hpp"
+#include "scaling_policy.hpp"
+#include "watermark.hpp"
+#include "topology.hpp"
+
+#ifndef POOL_CONTROLLER_HPP
+#define POOL_CONTROLLER_HPP
+
+// the least time between two scalings in microseconds when the controller
+// follows a watermark, so a queue swinging across the marks with every batch
+// does not scale the pool up and down with it
+#define POOL_CONTROLLER_MIN_INTERVAL 10000
+
+// Scales a pool of Worker stages (a BasicProducer<E> or a BasicConsumer<E>)
+// taking the items of one queue, by the decisions of a ScalingPolicy on
+// samples of that queue and of the pool. E is how the queues carry the items.
+template <class Worker, class E>
+class PoolController : public Thread {
+public:
+	// constructor, the controller takes ownership of policy,
+	// name is what the pool is called when it is scaled
+	PoolController(
+		std::string name,
+		Queue<E>* from,
+		Queue<E>* to,
+		Transformer* transformer,
+		int check_period,
+		ScalingPolicy* policy,
+		int initial_workers,
+		int max_workers,
+		int batch_size = 1,
+		bool soa = false
+	);
+
+	// destructor
+	virtual ~PoolController();
+
+	virtual void start() override;
+
+	// the cache the workers look their transforms up in, before start
+	void set_cache(TransformCache* cache);
+
+	// where the workers of the pool run, in domain of placement, before start
+	void set_placement(Placement* placement, int domain);
+
+	// the number of workers scaled up and the number of them sleeping parked
+	int get_active();
+	int get_parked();
+
+	// the stats of every worker in the pool, after start
+	std::vector<ServiceStats*> get_stats();
+
+private:
+	std::string name;
+
+	// The pool of workers, spawned by start, those past the initial ones
+	// parked. The first active ones are working, scaling up resumes
+	// workers[active] and scaling down parks workers[active - 1], so no
+	// thread is created after start.
+	std::vector<Worker*> workers;
+	int active;
+
+	// the queue the workers take from, which the controller samples,
+	// and the queue they give to
+	Queue<E>* from;
+	Queue<E>* to;
+
+	Transformer* transformer;
+
+	// Check to scale down or scale up every check period in microseconds.
+	// With a watermark the controller checks as soon as the queue crosses
+	// a mark, and while a check changes nothing it waits for that instead
+	// of the period.
+	int check_period;
+	// Decides the number of workers at every check.
+	ScalingPolicy* policy;
+	// The number of workers working from the start, and the size of the pool.
+	int initial_workers;
+	int max_workers;
+	// The batch size of the workers.
+	int batch_size;
+	// Whether the workers transform their batches as an ItemBatch.
+	bool soa;
+	// The transform cache of the workers, nullptr without one.
+	TransformCache* cache;
+	// Where the workers run, nullptr for anywhere.
+	Placement* placement;
+	int domain;
+	// Updated by the queue at the marks of the policy, nullptr unless
+	// both the policy and the queue support it.
+	Watermark* watermark;
+
+	// the totals of the worker stats and the time at the previous check
+	long long last_items;
+	long long last_busy_ns;
+	long long last_check_ns;
+
+	// what happened since the previous check
+	ScalingSample take_sample();
+
+	// resume or park workers until target of them are active
+	void scale_to(int target);
+
+	static void* process(void* arg);
+};
+
+// Implementation start
+
+template <class Worker, class E>
+PoolController<Worker, E>::PoolController(
+	std::string name,
+	Queue<E>* from,
+	Queue<E>* to,
+	Transformer* transformer,
+	int check_period,
+	ScalingPolicy* policy,
+	int initial_workers,
+	int max_workers,
+	int batch_size,
+	bool soa
+) : name(name),
+	active(0),
+	from(from),
+	to(to),
+	transformer(transformer),
+	check_period(check_period),
+	policy(policy),
+	initial_workers(initial_workers),
+	max_workers(max_workers),
+	batch_size(batch_size),
+	soa(soa),
+	cache(nullptr),
+	placement(nullptr),
+	domain(0),
+	watermark(nullptr),
+	last_items(0),
+	last_busy_ns(0),
+	last_check_ns(now_ns()) {
+	assert(policy && initial_workers >= 0 && max_workers > 0);
+}
+
+template <class Worker, class E>
+PoolController<Worker, E>::~PoolController() {
+	for (Worker* worker : workers) {
+		worker->stop();
+		delete worker;
+	}
+	delete policy;
+	if (watermark) {
+		from->set_watermark(nullptr);
+		delete watermark;
+	}
+}
+
+template <class Worker, class E>
+void PoolController<Worker, E>::start() {
+	for (int i = 0; i < max_workers; i++) {
+		Worker* worker = new Worker(from, to, transformer, batch_size, soa);
+		worker->set_cache(cache);
+		if (placement)
+			placement->place(worker, domain);
+		// the workers past the initial ones park as soon as they start
+		if (i >= initial_workers)
+			worker->cancel();
+		worker->start();
+		workers.push_back(worker);
+	}
+	active = std::min(initial_workers, max_workers);
+
+	int low, high;
+	if (policy->get_watermarks(&low, &high)) {
+		watermark = new Watermark(low, high);
+		if (!from->set_watermark(watermark)) {
+			delete watermark;
+			watermark = nullptr;
+		}
+	}
+
+	create(PoolController::process, (void*)this);
+}
+
+template <class Worker, class E>
+void PoolController<Worker, E>::set_cache(TransformCache* cache) {
+	this->cache = cache;
+}
+
+template <class Worker, class E>
+void PoolController<Worker, E>::set_placement(Placement* placement, int domain) {
+	this->placement = placement;
+	this->domain = domain;
+}
+
+template <class Worker, class E>
+int PoolController<Worker, E>::get_active() {
+	return active;
+}
+
+template <class Worker, class E>
+std::vector<ServiceStats*> PoolController<Worker, E>::get_stats() {
+	std::vector<ServiceStats*> stats;
+	for (Worker* worker : workers)
+		stats.push_back(&worker->get_stats());
+	return stats;
+}
+
+template <class Worker, class E>
+int PoolController<Worker, E>::get_parked() {
+	int parked = 0;
+	for (Worker* worker : workers)
+		parked += worker->is_parked();
+	return parked;
+}
+
+template <class Worker, class E>
+ScalingSample PoolController<Worker, E>::take_sample() {
+	long long items = 0, busy_ns = 0;
+	for (Worker* worker : workers) {
+		items += worker->get_stats().items.load(std::memory_order_relaxed);
+		busy_ns += worker->get_stats().busy_ns.load(std::memory_order_relaxed);
+	}
+	long long now = now_ns();
+
+	ScalingSample sample;
+	// with a WSQueue this is the backlog summed over all the deques
+	sample.queue_size = from->get_size();
+	sample.workers = active;
+	sample.max_workers = max_workers;
+	sample.interval = (now - last_check_ns) / 1e9;
+	sample.items = items - last_items;
+	sample.busy_time = (busy_ns - last_busy_ns) / 1e9;
+
+	last_items = items;
+	last_busy_ns = busy_ns;
+	last_check_ns = now;
+	return sample;
+}
+
+template <class Worker, class E>
+void PoolController<Worker, E>::scale_to(int target) {
+	// a policy asking for no workers keeps the last one, if there is one
+	target = std::max(std::min(target, max_workers), std::min(active, 1));
+	if (target > active) {
+		printf("Scaling up %s from %d to %d\n", name.c_str(), active, target);
+		while (active < target)
+			workers[active++]->resume();
+	} else if (target < active) {
+		printf("Scaling down %s from %d to %d\n", name.c_str(), active, target);
+		while (active > target)
+			workers[--active]->cancel();
+	}
+}
+
+template <class Worker, class E>
+void* PoolController<Worker, E>::process(void* arg) {
+	PoolController* controller = (PoolController*)arg;
+	Watermark* watermark = controller->watermark;
+	while (1) {
+		// taken before the sample, so a crossing after it is never missed
+		WatermarkBand band = watermark ? watermark->get_band() : BAND_EMPTY;
+
+		int active = controller->active;
+		ScalingSample sample = controller->take_sample();
+		int target = controller->policy->decide(sample);
+		// without a worker a backlog below the thresholds would never drain
+		if (sample.queue_size > 0)
+			target = std::max(target, 1);
+		controller->scale_to(target);
+
+		if (!watermark) {
+			usleep(controller->check_period);
+			continue;
+		}
+		// a policy that keeps stepping in this band checks every period,
+		// one that settled has nothing to do until the band changes
+		bool settled = controller->active == active;
+		if (!settled)
+			usleep(std::min(controller->check_period, POOL_CONTROLLER_MIN_INTERVAL));
+		watermark->wait(band, settled ? -1 : controller->check_period);
+	}
+	return nullptr;
+}
+
+#endif // POOL_CONTROLLER_HPP
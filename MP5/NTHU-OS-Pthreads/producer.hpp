@@ -1,56 +1,68 @@
 #include <pthread.h>
-#include "thread.hpp"
-#include "ts_queue.hpp"
+#include "stage.hpp"
+#include "queue.hpp"
 #include "item.hpp"
 #include "transformer.hpp"
+#include "item_batch.hpp"
 
 #ifndef PRODUCER_HPP
 #define PRODUCER_HPP
 
-class Producer : public Thread {
+// The producer stage: the producer transform of every item, batched by opcode.
+// Cancel parks it like a Consumer, for the ProducerController.
+// E is how the queues carry the items, Item* (a Producer) or Item.
+template <class E>
+class BasicProducer : public Stage<E, E> {
 public:
-	// constructor
-	Producer(TSQueue<Item*>* input_queue, TSQueue<Item*>* worker_queue, Transformer* transfomrer);
+	// constructor, with soa the batches are transformed as an ItemBatch
+	BasicProducer(Queue<E>* input_queue, Queue<E>* worker_queue, Transformer* transfomrer, int batch_size = 1,
+		bool soa = false);
 
 	// destructor
-	~Producer();
+	~BasicProducer();
 
-	virtual void start();
+	// look the transforms up in a cache shared with the other stages, before start
+	void set_cache(TransformCache* cache);
+protected:
+	virtual int work(E* items, int n, E* outputs) override;
 private:
-	TSQueue<Item*>* input_queue;
-	TSQueue<Item*>* worker_queue;
-
 	Transformer* transformer;
 
-	// the method for pthread to create a producer thread
-	static void* process(void* arg);
+	OpcodeBatcher batcher;
+	ItemBatch batch;
+	bool soa;
 };
 
-Producer::Producer(TSQueue<Item*>* input_queue, TSQueue<Item*>* worker_queue, Transformer* transformer)
-	: input_queue(input_queue), worker_queue(worker_queue), transformer(transformer) {
+typedef BasicProducer<Item*> Producer;
+
+template <class E>
+BasicProducer<E>::BasicProducer(Queue<E>* input_queue, Queue<E>* worker_queue, Transformer* transformer,
+	int batch_size, bool soa)
+	: Stage<E, E>(input_queue, worker_queue, batch_size), transformer(transformer), batcher(batch_size),
+	batch(batch_size), soa(soa) {
+	this->role = ROLE_PRODUCER;
 }
 
-Producer::~Producer() {}
+template <class E>
+BasicProducer<E>::~BasicProducer() {}
 
-void Producer::start() {
-	// TODO: starts a Producer thread
-	pthread_create(&t, 0, Producer::process, (void*) this);
+template <class E>
+void BasicProducer<E>::set_cache(TransformCache* cache) {
+	batcher.set_cache(cache, TRANSFORM_PRODUCER);
+	batch.set_cache(cache, TRANSFORM_PRODUCER);
 }
 
-void* Producer::process(void* arg) {
-	// TODO: implements the Producer's work
-	Producer* producer = (Producer*)arg;
-	pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, nullptr);
-
-	while(1){
-		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, nullptr);
-		Item* it = producer->input_queue->dequeue();
-		it -> val = producer->transformer->producer_transform(it->opcode, it->val);
-		producer->worker_queue->enqueue(it);
-		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, nullptr);
+template <class E>
+int BasicProducer<E>::work(E* items, int n, E* outputs) {
+	if (soa) {
+		batch.load(items, n);
+		batch.transform(transformer, &Transformer::producer_transform_batch);
+		batch.store(items);
+	} else {
+		batcher.transform(items, n, transformer, &Transformer::producer_transform_batch);
 	}
-
-	return nullptr;
+	std::copy(items, items + n, outputs);
+	return n;
 }
 
 #endif // PRODUCER_HPP
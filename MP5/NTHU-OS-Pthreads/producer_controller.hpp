@@ -0,0 +1,50 @@
+#include "producer.hpp"
+#include "queue.hpp"
+#include "item.hpp"
+#include "transformer.hpp"
+#include "scaling_policy.hpp"
+#include "pool_controller.hpp"
+
+#ifndef PRODUCER_CONTROLLER_HPP
+#define PRODUCER_CONTROLLER_HPP
+
+// Scales the producers on the input queue like the ConsumerController scales
+// the consumers on the worker queue, starting with initial_producers working.
+// E is how the queues carry the items, Item* (a ProducerController) or Item.
+template <class E>
+class BasicProducerController : public PoolController<BasicProducer<E>, E> {
+public:
+	// constructor, the controller takes ownership of policy
+	BasicProducerController(
+		Queue<E>* input_queue,
+		Queue<E>* worker_queue,
+		Transformer* transformer,
+		int check_period,
+		ScalingPolicy* policy,
+		int initial_producers,
+		int max_producers,
+		int producer_batch_size = 1,
+		bool soa = false
+	);
+};
+
+typedef BasicProducerController<Item*> ProducerController;
+
+// Implementation start
+
+template <class E>
+BasicProducerController<E>::BasicProducerController(
+	Queue<E>* input_queue,
+	Queue<E>* worker_queue,
+	Transformer* transformer,
+	int check_period,
+	ScalingPolicy* policy,
+	int initial_producers,
+	int max_producers,
+	int producer_batch_size,
+	bool soa
+) : PoolController<BasicProducer<E>, E>("producers", input_queue, worker_queue, transformer, check_period,
+	policy, initial_producers, max_producers, producer_batch_size, soa) {
+}
+
+#endif // PRODUCER_CONTROLLER_HPP
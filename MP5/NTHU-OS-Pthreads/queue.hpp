@@ -0,0 +1,87 @@
+#include <pthread.h>
+#include <atomic>
+#include "stats.hpp"
+#include "watermark.hpp"
+#include "lock_profile.hpp"
+
+#ifndef QUEUE_HPP
+#define QUEUE_HPP
+
+// the common interface of the bounded blocking queues used by the pipeline,
+// so that each queue in main.cpp can pick its implementation independently
+template <class T>
+class Queue {
+public:
+	virtual ~Queue() {}
+
+	// add an element to the end of the queue,
+	// blocks while the queue is full
+	virtual void enqueue(T item) = 0;
+
+	// remove and return the first element of the queue,
+	// blocks while the queue is empty
+	virtual T dequeue() = 0;
+
+	// add n elements to the end of the queue in order,
+	// blocks until all of them are in
+	virtual void enqueue_bulk(T* items, int n) = 0;
+
+	// remove up to max elements from the front of the queue into items,
+	// blocks until at least one is available and returns how many were taken.
+	// With a cancel flag it also returns 0 once the flag is set and the queue is
+	// empty; whoever sets the flag calls wake_dequeuers so the wait notices it.
+	virtual int dequeue_bulk(T* items, int max, const std::atomic<bool>* cancel = nullptr) = 0;
+
+	// wake every thread blocked in dequeue_bulk to recheck its cancel flag
+	virtual void wake_dequeuers() = 0;
+
+	// return the number of elements in the queue
+	virtual int get_size() = 0;
+
+	// count the operations and the blocked waits of the queue into stats,
+	// nullptr (the default) records nothing
+	void set_stats(QueueStats* stats) {
+		this->stats = stats;
+	}
+
+	// update watermark with every change of the depth, nullptr for none,
+	// false if the queue cannot (only a TSQueue does)
+	virtual bool set_watermark(Watermark* watermark) {
+		return watermark == nullptr;
+	}
+
+	// record how the threads contend for the queue into a profile, false if
+	// the queue does not (only a TSQueue of a TS_QUEUE_PROFILE build does)
+	virtual bool set_profile(LockProfile*) {
+		return false;
+	}
+protected:
+	QueueStats* stats = nullptr;
+
+	// pthread_cond_wait, adding the time blocked to the enqueue (or dequeue) wait of the stats
+	void wait(pthread_cond_t* cond, pthread_mutex_t* mutex, bool enqueue) {
+		if (!stats) {
+			pthread_cond_wait(cond, mutex);
+			return;
+		}
+		long long begin = now_ns();
+		pthread_cond_wait(cond, mutex);
+		(enqueue ? stats->enqueue_wait_ns : stats->dequeue_wait_ns).fetch_add(now_ns() - begin,
+			std::memory_order_relaxed);
+	}
+
+	// the same with the waiter of a wait policy (see wait_policy.hpp)
+	template <class Waiter>
+	void wait(Waiter* waiter, pthread_mutex_t* mutex, bool enqueue) {
+		if (!stats) {
+			waiter->wait(mutex);
+			return;
+		}
+		long long begin = now_ns();
+		waiter->wait(mutex);
+		(enqueue ? stats->enqueue_wait_ns : stats->dequeue_wait_ns).fetch_add(now_ns() - begin,
+			std::memory_order_relaxed);
+	}
+};
+
+#endif // QUEUE_HPP
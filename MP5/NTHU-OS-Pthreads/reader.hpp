@@ -1,57 +1,461 @@
+#include <stdio.h>
+#include <stdlib.h>
 #include <fstream>
-#include "thread.hpp"
-#include "ts_queue.hpp"
+#include <algorithm>
+#include <vector>
+#include <assert.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "stage.hpp"
+#include "queue.hpp"
 #include "item.hpp"
+#include "ordered_queue.hpp"
+#include "record.hpp"
+#include "checkpoint.hpp"
 
 #ifndef READER_HPP
 #define READER_HPP
 
-class Reader : public Thread {
+enum ReaderMode {
+	// read std::ifstream line by line with std::getline, parsing every line
+	// with parse_item like READER_MMAP
+	READER_STREAM,
+	// mmap the input file and parse it with a hand-written scanner
+	READER_MMAP,
+	// mmap an input file of records (record.hpp) and copy them out
+	READER_BINARY
+};
+
+// The source stage: pulls free items from the pool and reads them from the file.
+// E is how the queues carry the items, Item* (a Reader) or Item, which needs no pool.
+template <class E>
+class BasicReader : public Stage<E, E> {
 public:
 	// constructor
-	Reader(int expected_lines, std::string input_file, TSQueue<Item*>* input_queue);
+	// parse_threads only applies to READER_MMAP: with more than one thread
+	// the file is split into chunks at line boundaries and parsed in parallel
+	BasicReader(int expected_lines, std::string input_file, Queue<E>* input_queue, int batch_size = 1,
+		ItemPool* item_pool = nullptr, ReaderMode mode = READER_STREAM, int parse_threads = 1);
 
 	// destructor
-	~Reader();
+	~BasicReader();
+
+	// let an item into the pipeline only once its key is in the window of
+	// the reorder buffer, before start. The keys read (but for the ones the
+	// checkpoint skips) must then run from the first key of window up by one,
+	// the run stops with an error at the first that does not.
+	void set_window(OrderedQueue* window);
+
+	// stamp the items with the time they are read, before start
+	void set_read_times(ReadTimes* read_times);
+
+	// skip the items written by the run checkpoint resumes, before start,
+	// a key out of its range or read twice is an error
+	void set_checkpoint(Checkpoint* checkpoint);
+
+	// read from the bytes [begin, end) of the input file only, before start,
+	// begin is the start of a line, or of a record in READER_BINARY
+	void set_range(size_t begin, size_t end);
 
-	virtual void start() override;
+	// parse one "key val opcode" line from [p, end) into item, return where
+	// the line ends or nullptr if there is no more item. A line that is not
+	// exactly that, or has a key out of the range of an int or a val out of
+	// 64 bits, is malformed: it returns nullptr with malformed set to the line.
+	static const char* parse_item(const char* p, const char* end, Item* item, const char** malformed);
+protected:
+	virtual void begin() override;
+	virtual void finish() override;
+
+	// up to max free items, -1 after the expected lines
+	virtual int pull(E* items, int max) override;
+
+	// read the items from the input file
+	virtual int work(E* items, int n, E* outputs) override;
 private:
+	// a part of the mapped file parsed by its own thread
+	struct ParseChunk {
+		const char* begin;
+		const char* end;
+		std::vector<Item> items;
+		// the line the parse stopped at, nullptr if it parsed to the end
+		const char* malformed;
+		pthread_t t;
+	};
+
 	// the expected lines to read,
 	// the reader thread finished after input expected lines of item
 	int expected_lines;
 
+	std::string input_file;
 	std::ifstream ifs;
-	TSQueue<Item*>* input_queue;
 
-	// the method for pthread to create a reader thread
-	static void* process(void* arg);
+	// where the items come from, items are allocated with new without a pool
+	ItemPool::Cache cache;
+
+	ReaderMode mode;
+	int parse_threads;
+
+	// the reorder buffer the items wait for, the first key it has not admitted
+	// yet and the key the next item must have
+	OrderedQueue* window;
+	int admitted;
+	int next_key;
+
+	ReadTimes* read_times;
+
+	Checkpoint* checkpoint;
+
+	// the mapped input file, the part of it to read and the parse position in it
+	const char* mapped;
+	size_t mapped_size;
+	const char* data;
+	size_t size;
+	const char* cursor;
+
+	// the chunks of a parallel parse, the chunk being emitted and the next item in it
+	std::vector<ParseChunk> chunks;
+	size_t chunk_index;
+	size_t record_index;
+
+	// split the mapped file into chunks and start parsing them
+	void start_parse_threads();
+
+	// fill item with the next item of the input
+	void read_item(Item* item);
+
+	// print the malformed line [line, end) and exit, the items past it are
+	// not what the run expects
+	void malformed_input(const char* line, const char* end);
+
+	// the method for pthread to parse a chunk
+	static void* parse_chunk(void* arg);
 };
 
+typedef BasicReader<Item*> Reader;
+
 // Implementaion start
 
-Reader::Reader(int expected_lines, std::string input_file, TSQueue<Item*>* input_queue)
-	: expected_lines(expected_lines), input_queue(input_queue) {
-	ifs = std::ifstream(input_file);
+template <class E>
+BasicReader<E>::BasicReader(int expected_lines, std::string input_file, Queue<E>* input_queue, int batch_size,
+	ItemPool* item_pool, ReaderMode mode, int parse_threads)
+	: Stage<E, E>(nullptr, input_queue, batch_size), expected_lines(expected_lines), input_file(input_file),
+	cache(item_pool),
+	mode(mode), parse_threads(parse_threads), window(nullptr), admitted(INT_MIN), next_key(0), read_times(nullptr), checkpoint(nullptr),
+	mapped(nullptr), mapped_size(0), data(nullptr), size(0), cursor(nullptr),
+	chunk_index(0), record_index(0) {
+	this->role = ROLE_READER;
+	if (mode == READER_STREAM) {
+		ifs = std::ifstream(input_file);
+		return;
+	}
+
+	int fd = open(input_file.c_str(), O_RDONLY);
+	assert(fd >= 0);
+
+	struct stat st;
+	fstat(fd, &st);
+	size = st.st_size;
+
+	if (size > 0) {
+		void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		assert(addr != MAP_FAILED);
+		madvise(addr, size, MADV_SEQUENTIAL);
+		mapped = (const char*)addr;
+	}
+	mapped_size = size;
+	data = mapped;
+
+	if (mode == READER_BINARY) {
+		assert(is_record_file(mapped, mapped_size) && "the input file is not a file of records");
+		data = mapped + sizeof(RecordHeader);
+		size = mapped_size - sizeof(RecordHeader);
+	}
+	cursor = data;
+
+	// the mapping stays valid after the file is closed
+	close(fd);
+}
+
+template <class E>
+BasicReader<E>::~BasicReader() {
+	if (mode == READER_STREAM)
+		ifs.close();
+	else if (mapped)
+		munmap((void*)mapped, mapped_size);
+}
+
+static inline bool is_space(char c) {
+	return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static inline const char* skip_space(const char* p, const char* end) {
+	while (p < end && is_space(*p))
+		p++;
+	return p;
 }
 
-Reader::~Reader() {
-	ifs.close();
+// the space within a line
+static inline const char* skip_blank(const char* p, const char* end) {
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+		p++;
+	return p;
 }
 
-void Reader::start() {
-	pthread_create(&t, 0, Reader::process, (void*)this);
+static inline bool is_digit(char c) {
+	return c >= '0' && c <= '9';
 }
 
-void* Reader::process(void* arg) {
-	Reader* reader = (Reader*)arg;
+template <class E>
+const char* BasicReader<E>::parse_item(const char* p, const char* end, Item* item, const char** malformed) {
+	*malformed = nullptr;
+	p = skip_space(p, end);
+	if (p == end)
+		return nullptr;
+	const char* line = p;
+
+	bool negative = *p == '-';
+	if (*p == '-' || *p == '+')
+		p++;
+	const char* digits = p;
+	// stops one digit past the range of an int, there is no overflow
+	long long key = 0;
+	while (p < end && is_digit(*p) && key <= (long long)INT_MAX + 1)
+		key = key * 10 + (*p++ - '0');
+	bool ok = p > digits && key <= (long long)INT_MAX + negative;
+
+	const char* field = skip_blank(p, end);
+	ok = ok && field > p;
+	p = digits = field;
+	unsigned long long val = 0;
+	while (ok && p < end && is_digit(*p)) {
+		int digit = *p++ - '0';
+		ok = val <= (ULLONG_MAX - digit) / 10;
+		val = val * 10 + digit;
+	}
+	ok = ok && p > digits;
 
-	while (reader->expected_lines--) {
-		Item *item = new Item;
-		reader->ifs >> *item;
-		reader->input_queue->enqueue(item);
+	// the opcode, then nothing but the end of the line
+	field = skip_blank(p, end);
+	ok = ok && field > p && field < end && !is_space(*field);
+	if (ok) {
+		p = skip_blank(field + 1, end);
+		ok = p == end || *p == '\n';
+	}
+	if (!ok) {
+		*malformed = line;
+		return nullptr;
 	}
 
+	item->key = negative ? -key : key;
+	item->val = val;
+	item->opcode = *field;
+	return p;
+}
+
+template <class E>
+void* BasicReader<E>::parse_chunk(void* arg) {
+	ParseChunk* chunk = (ParseChunk*)arg;
+
+	const char* p = chunk->begin;
+	Item item;
+	while ((p = parse_item(p, chunk->end, &item, &chunk->malformed)))
+		chunk->items.push_back(item);
+
 	return nullptr;
 }
 
+template <class E>
+void BasicReader<E>::set_window(OrderedQueue* window) {
+	this->window = window;
+	if (window)
+		next_key = window->get_first_key();
+}
+
+template <class E>
+void BasicReader<E>::set_read_times(ReadTimes* read_times) {
+	this->read_times = read_times;
+}
+
+template <class E>
+void BasicReader<E>::set_checkpoint(Checkpoint* checkpoint) {
+	this->checkpoint = checkpoint;
+}
+
+template <class E>
+void BasicReader<E>::set_range(size_t begin, size_t end) {
+	if (mode == READER_STREAM) {
+		ifs.seekg(begin);
+		return;
+	}
+
+	// the header is not a part of any range
+	if (mode == READER_BINARY)
+		begin = std::max(begin, sizeof(RecordHeader));
+	begin = std::min(begin, mapped_size);
+	end = std::max(begin, std::min(end, mapped_size));
+	data = mapped + begin;
+	size = end - begin;
+	cursor = data;
+}
+
+template <class E>
+void BasicReader<E>::start_parse_threads() {
+	chunks.resize(parse_threads);
+
+	const char* begin = data;
+	for (int i = 0; i < parse_threads; i++) {
+		// every chunk but the last ends right after a newline
+		const char* end = data + size * (i + 1) / parse_threads;
+		if (i == parse_threads - 1)
+			end = data + size;
+		else if (end < begin)
+			end = begin;
+		while (end < data + size && end > data && end[-1] != '\n')
+			end++;
+
+		chunks[i].begin = begin;
+		chunks[i].end = end;
+		pthread_create(&chunks[i].t, 0, BasicReader::parse_chunk, (void*)&chunks[i]);
+		begin = end;
+	}
+}
+
+template <class E>
+void BasicReader<E>::read_item(Item* item) {
+	const char* malformed;
+	if (mode == READER_STREAM) {
+		// a line at a time, the blank ones skipped like the mapped parse does
+		std::string line;
+		const char* next = nullptr;
+		while (!next && std::getline(ifs, line)) {
+			next = parse_item(line.data(), line.data() + line.size(), item, &malformed);
+			if (malformed)
+				malformed_input(malformed, line.data() + line.size());
+		}
+		assert(next && "the input file has fewer items than expected");
+		return;
+	}
+
+	if (mode == READER_BINARY) {
+		assert(cursor + sizeof(Record) <= data + size && "the input file has fewer items than expected");
+		read_record(cursor, item);
+		cursor += sizeof(Record);
+		return;
+	}
+
+	if (parse_threads <= 1) {
+		cursor = parse_item(cursor, data + size, item, &malformed);
+		if (malformed)
+			malformed_input(malformed, data + size);
+		assert(cursor && "the input file has fewer items than expected");
+		return;
+	}
+
+	// emit the chunks in file order, waiting for each one to be parsed
+	while (record_index == chunks[chunk_index].items.size()) {
+		if (chunks[chunk_index].malformed)
+			malformed_input(chunks[chunk_index].malformed, chunks[chunk_index].end);
+		std::vector<Item>().swap(chunks[chunk_index].items);
+		chunk_index++;
+		assert(chunk_index < chunks.size() && "the input file has fewer items than expected");
+		pthread_join(chunks[chunk_index].t, 0);
+		record_index = 0;
+	}
+	*item = chunks[chunk_index].items[record_index++];
+}
+
+template <class E>
+void BasicReader<E>::malformed_input(const char* line, const char* end) {
+	const char* line_end = std::find(line, end, '\n');
+	// the line number is known in the mapped file only
+	if (line >= mapped && line < mapped + mapped_size)
+		fprintf(stderr, "%s:%ld: ", input_file.c_str(), (long)std::count(mapped, line, '\n') + 1);
+	else
+		fprintf(stderr, "%s: ", input_file.c_str());
+	fprintf(stderr, "malformed item \"%.*s\", expected \"key val opcode\"\n",
+		(int)std::min<ptrdiff_t>(line_end - line, 80), line);
+	exit(1);
+}
+
+template <class E>
+void BasicReader<E>::begin() {
+	if (mode == READER_MMAP && parse_threads > 1) {
+		start_parse_threads();
+		pthread_join(chunks[0].t, 0);
+	}
+}
+
+template <class E>
+void BasicReader<E>::finish() {
+	// the chunks past the expected lines still have to be joined
+	if (mode == READER_MMAP && parse_threads > 1) {
+		for (size_t i = chunk_index + 1; i < chunks.size(); i++)
+			pthread_join(chunks[i].t, 0);
+	}
+}
+
+template <class E>
+int BasicReader<E>::pull(E* items, int max) {
+	if (expected_lines == 0)
+		return -1;
+
+	int n = std::min(max, expected_lines);
+	for (int i = 0; i < n; i++)
+		acquire_item(cache, items[i]);
+	expected_lines -= n;
+	return n;
+}
+
+template <class E>
+int BasicReader<E>::work(E* items, int n, E* outputs) {
+	// the items of a batch share one timestamp
+	long long now = read_times ? now_ns() : 0;
+	int pushed = 0;
+	int count = 0;
+	for (int i = 0; i < n; i++) {
+		Item& item = item_ref(items[i]);
+		read_item(&item);
+		if (checkpoint && !checkpoint->read(item.key)) {
+			int first = checkpoint->get_first_key(), last = first + checkpoint->get_n();
+			if (item.key < first || item.key >= last)
+				fprintf(stderr, "%s: key %d is out of [%d, %d), the keys a checkpoint records\n",
+					input_file.c_str(), item.key, first, last);
+			else
+				fprintf(stderr, "%s: key %d repeats, a checkpoint takes every key once\n", input_file.c_str(),
+					item.key);
+			exit(1);
+		}
+		if (checkpoint && checkpoint->was_written(item.key)) {
+			release_item(cache, items[i]);
+			continue;
+		}
+		if (window) {
+			if (item.key != next_key) {
+				fprintf(stderr, "%s: key %d where key %d was expected, an ordered output takes the keys from "
+					"%d in order, with no gap or repeat\n", input_file.c_str(), item.key, next_key,
+					window->get_first_key());
+				exit(1);
+			}
+			next_key++;
+		}
+		if (read_times)
+			read_times->stamp(item.key, now);
+		outputs[count] = items[i];
+
+		if (window && item.key >= admitted) {
+			// the window may be waiting for the items read before this one
+			this->push(outputs + pushed, count - pushed);
+			pushed = count;
+			admitted = window->admit(item.key);
+		}
+		count++;
+	}
+
+	std::copy(outputs + pushed, outputs + count, outputs);
+	return count - pushed;
+}
+
 #endif // READER_HPP
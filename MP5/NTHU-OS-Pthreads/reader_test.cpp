@@ -1,9 +1,63 @@
 #include <unistd.h>
+#include <string.h>
+#include <assert.h>
+#include <stdio.h>
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include "ts_queue.hpp"
 #include "reader.hpp"
 
+// whether text parses as one item, into item
+bool parses(const char* text, Item* item) {
+	const char* malformed;
+	const char* end = Reader::parse_item(text, text + strlen(text), item, &malformed);
+	assert(!end == (malformed != nullptr));
+	return end;
+}
+
+// the items at the ends of the ranges parse, the lines out of range or
+// with a field missing or anything after the opcode are malformed
+void test_parse_item() {
+	Item item;
+	assert(parses(" 12 34 A \r\n", &item) && item.key == 12 && item.val == 34 && item.opcode == 'A');
+	assert(parses("-2147483648 18446744073709551615 B", &item));
+	assert(item.key == INT_MIN && item.val == ULLONG_MAX && item.opcode == 'B');
+	assert(parses("2147483647 0 C\n", &item) && item.key == INT_MAX);
+
+	const char* malformed[] = {"2147483648 0 A", "-2147483649 0 A", "99999999999999999999 0 A",
+		"1 18446744073709551616 A", "1 184467440737095516150 A", "x 1 A", "- 1 A", "1 A", "1 2",
+		"1 2 AB", "1 2 A x", "12x 3 A", "1\n2 A"};
+	for (const char* text : malformed)
+		assert(!parses(text, &item));
+
+	const char* blank = " \n\n";
+	const char* at;
+	assert(!Reader::parse_item(blank, blank + strlen(blank), &item, &at) && !at);
+}
+
+// parse_item reads every line of file into the item Item's operator>> reads
+void test_same_as_extraction(std::string file) {
+	std::ifstream in(file);
+	assert(in);
+	std::string line;
+	int lines = 0;
+	while (std::getline(in, line)) {
+		Item parsed, extracted;
+		assert(parses(line.c_str(), &parsed));
+		std::istringstream(line) >> extracted;
+		assert(parsed.key == extracted.key && parsed.val == extracted.val && parsed.opcode == extracted.opcode);
+		lines++;
+	}
+	printf("%s: %d lines parsed as operator>> reads them\n", file.c_str(), lines);
+	assert(lines > 0);
+}
+
 int main() {
+	test_parse_item();
+	test_same_as_extraction("./tests/00.in");
+	test_same_as_extraction("./tests/01.in");
+
 	TSQueue<Item*>* q = new TSQueue<Item*>;
 
 	Reader* reader = new Reader(80, "./tests/00.in", q);
@@ -0,0 +1,74 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "item.hpp"
+
+#ifndef RECORD_HPP
+#define RECORD_HPP
+
+// The binary format of the input and the output, an alternative to the
+// "key val opcode" lines: a RecordHeader, then one 16-byte Record per item,
+// little-endian. A Record has the layout of an Item, so a mapped file is read
+// by copying the records out, without parsing anything.
+// scripts/convert.py converts between the two formats.
+
+#define RECORD_MAGIC "NTHUITEM"
+#define RECORD_VERSION 1
+
+struct RecordHeader {
+	char magic[8];
+	uint32_t version;
+	// the size of every record, sizeof(Record)
+	uint32_t record_size;
+};
+
+struct Record {
+	uint64_t val;
+	int32_t key;
+	char opcode;
+	// zero
+	char pad[3];
+};
+
+static_assert(sizeof(RecordHeader) == 16, "a RecordHeader is 16 bytes");
+static_assert(sizeof(Record) == 16, "a Record is 16 bytes");
+static_assert(offsetof(Record, val) == offsetof(Item, val) && offsetof(Record, key) == offsetof(Item, key) &&
+	offsetof(Record, opcode) == offsetof(Item, opcode), "a Record has the layout of an Item");
+
+// whether [data, data + size) starts with the header of this version
+static inline bool is_record_file(const char* data, size_t size) {
+	if (size < sizeof(RecordHeader))
+		return false;
+	RecordHeader header;
+	memcpy(&header, data, sizeof(header));
+	return memcmp(header.magic, RECORD_MAGIC, 8) == 0 && header.version == RECORD_VERSION &&
+		header.record_size == sizeof(Record);
+}
+
+// write the header to out, return the end of it
+static inline char* write_record_header(char* out) {
+	RecordHeader header;
+	memcpy(header.magic, RECORD_MAGIC, 8);
+	header.version = RECORD_VERSION;
+	header.record_size = sizeof(Record);
+	memcpy(out, &header, sizeof(header));
+	return out + sizeof(header);
+}
+
+// read the record at p into item
+static inline void read_record(const char* p, Item* item) {
+	Record record;
+	memcpy(&record, p, sizeof(record));
+	item->val = record.val;
+	item->key = record.key;
+	item->opcode = record.opcode;
+}
+
+// write item as a record to out, return the end of it
+static inline char* write_record(char* out, const Item& item) {
+	Record record = {item.val, item.key, item.opcode, {0, 0, 0}};
+	memcpy(out, &record, sizeof(record));
+	return out + sizeof(record);
+}
+
+#endif // RECORD_HPP
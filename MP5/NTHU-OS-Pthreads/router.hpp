@@ -0,0 +1,94 @@
+#include <assert.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "stage.hpp"
+#include "queue.hpp"
+#include "item.hpp"
+
+#ifndef ROUTER_HPP
+#define ROUTER_HPP
+
+// A stage that splits the items of its input queue by opcode: every item
+// goes to the queue of the route its opcode is in, unchanged.
+// E is how the queues carry the items, Item* (a Router) or Item.
+template <class E>
+class BasicRouter : public Stage<E, E> {
+public:
+	// constructor, the routes are added before start
+	BasicRouter(Queue<E>* input_queue, int batch_size = 1);
+
+	// destructor
+	~BasicRouter();
+
+	// send the items with an opcode in opcodes to queue,
+	// "*" sends every opcode without a route of its own
+	void add_route(std::string opcodes, Queue<E>* queue);
+protected:
+	virtual int work(E* items, int n, E* outputs) override;
+
+	// enqueue the items to their queues, one bulk per queue
+	virtual void push(E* items, int n) override;
+private:
+	// the queue of each opcode, nullptr without a route
+	Queue<E>* routes[256];
+	Queue<E>* fallback;
+
+	// the distinct queues of the routes and the items of a batch for each
+	std::vector<Queue<E>*> queues;
+	std::vector<std::vector<E> > pending;
+};
+
+typedef BasicRouter<Item*> Router;
+
+// Implementation start
+
+template <class E>
+BasicRouter<E>::BasicRouter(Queue<E>* input_queue, int batch_size)
+	: Stage<E, E>(input_queue, nullptr, batch_size), fallback(nullptr) {
+	this->role = ROLE_ROUTER;
+	std::fill(routes, routes + 256, nullptr);
+}
+
+template <class E>
+BasicRouter<E>::~BasicRouter() {}
+
+template <class E>
+void BasicRouter<E>::add_route(std::string opcodes, Queue<E>* queue) {
+	if (opcodes == "*")
+		fallback = queue;
+	else
+		for (char opcode : opcodes)
+			routes[(unsigned char)opcode] = queue;
+
+	if (std::find(queues.begin(), queues.end(), queue) == queues.end()) {
+		queues.push_back(queue);
+		pending.push_back(std::vector<E>());
+		pending.back().reserve(this->batch_size);
+	}
+}
+
+template <class E>
+int BasicRouter<E>::work(E* items, int n, E* outputs) {
+	std::copy(items, items + n, outputs);
+	return n;
+}
+
+template <class E>
+void BasicRouter<E>::push(E* items, int n) {
+	for (int i = 0; i < n; i++) {
+		Queue<E>* queue = routes[(unsigned char)item_ref(items[i]).opcode];
+		if (!queue)
+			queue = fallback;
+		assert(queue && "no route for the opcode of an item");
+		pending[std::find(queues.begin(), queues.end(), queue) - queues.begin()].push_back(items[i]);
+	}
+
+	for (size_t q = 0; q < queues.size(); q++) {
+		if (!pending[q].empty())
+			queues[q]->enqueue_bulk(pending[q].data(), pending[q].size());
+		pending[q].clear();
+	}
+}
+
+#endif // ROUTER_HPP
@@ -0,0 +1,147 @@
+#include <math.h>
+#include <algorithm>
+#include "stats.hpp"
+
+#ifndef SCALING_POLICY_HPP
+#define SCALING_POLICY_HPP
+
+// what a controller sees of its stage at every check
+struct ScalingSample {
+	// the number of items waiting in the queue the stage takes from
+	int queue_size;
+	// the number of workers running and the size of the pool
+	int workers;
+	int max_workers;
+	// the seconds since the previous sample
+	double interval;
+	// the items the workers finished during the interval,
+	// and the seconds they were busy with them
+	long long items;
+	double busy_time;
+};
+
+// decides how many workers a stage should run
+class ScalingPolicy {
+public:
+	virtual ~ScalingPolicy() {}
+
+	// the number of workers wanted after this sample,
+	// the controller clamps it to the size of the pool
+	virtual int decide(const ScalingSample& sample) = 0;
+
+	// the marks of a policy that only decides by the band (see watermark.hpp)
+	// the queue size is in: with the same band and workers it decides the
+	// same, so a controller can wait for the band to change. False otherwise.
+	virtual bool get_watermarks(int*, int*) {
+		return false;
+	}
+};
+
+// one worker more above high_threshold and one less below low_threshold,
+// never scaling down the last worker
+class ThresholdPolicy : public ScalingPolicy {
+public:
+	ThresholdPolicy(int low_threshold, int high_threshold)
+		: low_threshold(low_threshold), high_threshold(high_threshold) {}
+
+	virtual int decide(const ScalingSample& sample) override {
+		if (sample.queue_size > high_threshold)
+			return sample.workers + 1;
+		if (sample.queue_size < low_threshold && sample.workers > 1)
+			return sample.workers - 1;
+		return sample.workers;
+	}
+
+	virtual bool get_watermarks(int* low, int* high) override {
+		*low = low_threshold;
+		*high = high_threshold;
+		return true;
+	}
+private:
+	int low_threshold;
+	int high_threshold;
+};
+
+// A PID controller holding the queue at setpoint (a fraction of its capacity),
+// in velocity form: every check it moves the number of workers by
+//   (kp * (e - e1) + ki * e + kd * (e - 2 * e1 + e2)) * max_workers
+// where e, e1 and e2 are the last three errors (the distance from the
+// setpoint as a fraction of the capacity). So the step grows with the
+// backlog, the kp term follows the growth rate of the queue, and the
+// fractions of a worker add up over the checks. Within dead_band of the
+// setpoint nothing changes, so the pool does not flap around it.
+class PIDPolicy : public ScalingPolicy {
+public:
+	PIDPolicy(int capacity, double setpoint = 0.5, double kp = 0.5, double ki = 0.1, double kd = 0.1,
+		double dead_band = 0.1)
+		: capacity(capacity), setpoint(setpoint), kp(kp), ki(ki), kd(kd), dead_band(dead_band),
+		last_error(0), second_last_error(0), pending(0) {}
+
+	virtual int decide(const ScalingSample& sample) override {
+		double error = (double)sample.queue_size / capacity - setpoint;
+		double output = kp * (error - last_error) + ki * error +
+			kd * (error - 2 * last_error + second_last_error);
+		second_last_error = last_error;
+		last_error = error;
+
+		if (fabs(error) < dead_band) {
+			pending = 0;
+			return std::max(sample.workers, 1);
+		}
+
+		pending += output * sample.max_workers;
+		int step = (int)pending;
+		pending -= step;
+		return std::max(sample.workers + step, 1);
+	}
+private:
+	int capacity;
+	double setpoint;
+	double kp, ki, kd;
+	double dead_band;
+
+	double last_error;
+	double second_last_error;
+	// the part of a worker asked for but not applied yet
+	double pending;
+};
+
+// Enough workers to serve the arrivals and drain the backlog within
+// target_latency seconds, from the measured per-item service time:
+//   workers = service_time * (arrival_rate + queue_size / target_latency)
+// Scaling up jumps to the estimate, scaling down goes one worker at a time
+// and only once the estimate is below (1 - margin) of the workers running.
+class TargetLatencyPolicy : public ScalingPolicy {
+public:
+	explicit TargetLatencyPolicy(double target_latency, double margin = 0.2)
+		: target_latency(target_latency), margin(margin), service_time(0), last_queue_size(0) {}
+
+	virtual int decide(const ScalingSample& sample) override {
+		if (sample.items > 0)
+			service_time = sample.busy_time / sample.items;
+
+		double arrival_rate = 0;
+		if (sample.interval > 0)
+			arrival_rate = std::max(0.0, (sample.items + sample.queue_size - last_queue_size) / sample.interval);
+		last_queue_size = sample.queue_size;
+
+		if (service_time == 0) {
+			// nothing measured yet, start a worker if there is work
+			return sample.queue_size > 0 ? std::max(sample.workers, 1) : sample.workers;
+		}
+
+		int wanted = (int)ceil(service_time * (arrival_rate + sample.queue_size / target_latency));
+		wanted = std::max(wanted, 1);
+		if (wanted < sample.workers * (1 - margin))
+			return sample.workers - 1;
+		return std::max(wanted, sample.workers);
+	}
+private:
+	double target_latency;
+	double margin;
+	// the seconds one worker spends per item
+	double service_time;
+	int last_queue_size;
+};
+
+#endif // SCALING_POLICY_HPP
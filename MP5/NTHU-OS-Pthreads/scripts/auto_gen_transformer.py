@@ -3,57 +3,147 @@
 import click
 import json
 
-def generate_case(opcode, annotation, case_spec):
+def generate_spec(opcode, annotation, case_spec):
+	template = f'''
+	// {opcode}: {annotation}
+	make_transform_spec({case_spec['a']}, {case_spec['b']}, {case_spec['m']}, {case_spec['iterations']}),'''
+
+	return template
+
+def generate_case(opcode, index, specs):
+	template = f'''
+	case '{opcode}':
+		return &{specs}[{index}];
+'''
+
+	return template
+
+def generate_kernel_case(opcode, case_spec):
+	template = f'''
+	case '{opcode}':
+		return TransformKernel<{case_spec['a']}, {case_spec['b']}, {case_spec['m']}, {case_spec['iterations']}>::iterate(val);
+'''
+
+	return template
+
+def generate_kernel_batch_case(opcode, case_spec):
 	template = f'''
-	// {annotation}
 	case '{opcode}':
-		spec->a = {case_spec['a']};
-		spec->b = {case_spec['b']};
-		spec->m = {case_spec['m']};
-		spec->iterations = {case_spec['iterations']};
+		TransformKernel<{case_spec['a']}, {case_spec['b']}, {case_spec['m']}, {case_spec['iterations']}>::iterate_batch(vals, n);
 		break;
 '''
-	
+
 	return template
 
-def generate_cpp(spec):
-	producer_spec = ''
-	for opcode in spec['annotation']:
-		producer_spec += generate_case(opcode, spec['annotation'][opcode], spec['producer'][opcode])
+def generate_transform(stage):
+	template = f'''
+unsigned long long Transformer::{stage}_transform(char opcode, unsigned long long val) {{
+	switch (mode) {{
+	case TRANSFORM_ITERATIVE:
+		return {stage}_iterate(opcode, val);
+
+	case TRANSFORM_VERIFY: {{
+		unsigned long long expected = iterate({stage}_spec(opcode), val);
+		assert({stage}_iterate(opcode, val) == expected);
+		assert(jump({stage}_spec(opcode), val) == expected);
+		return expected;
+	}}
+
+	default:
+		return jump({stage}_spec(opcode), val);
+	}}
+}}
+'''
+
+	return template
 
-	consumer_spec = ''
-	for opcode in spec['annotation']:
-		consumer_spec += generate_case(opcode, spec['annotation'][opcode], spec['consumer'][opcode])
+def generate_cpp(spec):
+	producer_specs = ''
+	consumer_specs = ''
+	producer_cases = ''
+	consumer_cases = ''
+	producer_kernels = ''
+	consumer_kernels = ''
+	producer_batch_kernels = ''
+	consumer_batch_kernels = ''
+	for index, opcode in enumerate(spec['annotation']):
+		producer_specs += generate_spec(opcode, spec['annotation'][opcode], spec['producer'][opcode])
+		consumer_specs += generate_spec(opcode, spec['annotation'][opcode], spec['consumer'][opcode])
+		producer_cases += generate_case(opcode, index, 'producer_specs')
+		consumer_cases += generate_case(opcode, index, 'consumer_specs')
+		producer_kernels += generate_kernel_case(opcode, spec['producer'][opcode])
+		consumer_kernels += generate_kernel_case(opcode, spec['consumer'][opcode])
+		producer_batch_kernels += generate_kernel_batch_case(opcode, spec['producer'][opcode])
+		consumer_batch_kernels += generate_kernel_batch_case(opcode, spec['consumer'][opcode])
 
 	template = f'''// CODEGEN BY auto_gen_transformer.py; DO NOT EDIT.
 
 #include <assert.h>
 #include "transformer.hpp"
 
-unsigned long long Transformer::producer_transform(char opcode, unsigned long long val) {{
-	TransformSpec* spec = new TransformSpec;
+// the jump-ahead maps are folded at compile time
+static constexpr TransformSpec producer_specs[] = {{{producer_specs}
+}};
+
+static constexpr TransformSpec consumer_specs[] = {{{consumer_specs}
+}};
+
+const TransformSpec* Transformer::producer_spec(char opcode) {{
+	switch (opcode) {{{producer_cases}
+	default:
+		assert(false);
+		return nullptr;
+	}}
+}}
+
+const TransformSpec* Transformer::consumer_spec(char opcode) {{
+	switch (opcode) {{{consumer_cases}
+	default:
+		assert(false);
+		return nullptr;
+	}}
+}}
 
-	switch (opcode) {{{producer_spec}
+unsigned long long Transformer::producer_iterate(char opcode, unsigned long long val) {{
+	switch (opcode) {{{producer_kernels}
 	default:
 		assert(false);
+		return val;
 	}}
+}}
 
-	return transform(spec, val);
+unsigned long long Transformer::consumer_iterate(char opcode, unsigned long long val) {{
+	switch (opcode) {{{consumer_kernels}
+	default:
+		assert(false);
+		return val;
+	}}
 }}
 
-unsigned long long Transformer::consumer_transform(char opcode, unsigned long long val) {{
-	TransformSpec* spec = new TransformSpec;
+void Transformer::producer_iterate_batch(char opcode, unsigned long long* vals, int n) {{
+	switch (opcode) {{{producer_batch_kernels}
+	default:
+		assert(false);
+	}}
+}}
 
-	switch (opcode) {{{consumer_spec}
+void Transformer::consumer_iterate_batch(char opcode, unsigned long long* vals, int n) {{
+	switch (opcode) {{{consumer_batch_kernels}
 	default:
 		assert(false);
 	}}
+}}
+{generate_transform('producer')}{generate_transform('consumer')}
+unsigned long long Transformer::jump(const TransformSpec* spec, unsigned long long val) {{
+	if (spec->iterations <= 0)
+		return val;
 
-	return transform(spec, val);
+	val = (val * spec->a + spec->b) % spec->m;
+	return (val * spec->jump.a + spec->jump.b) % spec->m;
 }}
 
-unsigned long long Transformer::transform(TransformSpec* spec, unsigned long long val) {{
-	while (spec->iterations--) {{
+unsigned long long Transformer::iterate(const TransformSpec* spec, unsigned long long val) {{
+	for (int i = 0; i < spec->iterations; i++) {{
 		val = (val * spec->a + spec->b) % spec->m;
 	}}
   return val;
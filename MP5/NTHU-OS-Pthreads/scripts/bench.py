@@ -0,0 +1,185 @@
+import click
+import copy
+import csv
+import hashlib
+import itertools
+import json
+import os
+import resource
+import subprocess
+import sys
+import time
+
+# The workloads share the transformer of the spec and differ in their opcode
+# mix, picked from the annotations of tests/01_spec.json:
+#   B and E: the consumer is faster, the producers are the bottleneck
+#   C and D: the producer is faster, the consumers are the bottleneck
+#   A: both stages take the same time
+#   all of them: items of very different costs, for the priority queue
+WORKLOADS = {
+	'producer_bound': ['B', 'E'],
+	'consumer_bound': ['C', 'D'],
+	'balanced': ['A'],
+	'mixed': ['A', 'B', 'C', 'D', 'E'],
+}
+
+FIELDS = ['workload', 'n', 'queue_type', 'queue_size', 'output_queue', 'producers', 'max_consumers', 'scaling', 'placement', 'run',
+	'ok', 'wall_s', 'items_per_s', 'p50_us', 'p99_us', 'cpu_s', 'cpu_utilization', 'items_per_cpu_s', 'busy_s']
+
+def split(values, kind=str):
+	return [kind(v) for v in values.split(',') if v]
+
+def run(command, **kwargs):
+	print('\033[1;34;48m' + ' '.join(command) + '\033[1;37;0m', file=sys.stderr)
+	subprocess.run(command, check=True, **kwargs)
+
+def build(spec, scale, directory, cxx, cxxflags):
+	# the iterations scaled down, so that the iterative transform takes
+	# a measurable but short time per item
+	spec = copy.deepcopy(spec)
+	for stage in ('producer', 'consumer'):
+		for case in spec['auto_gen_transformer'][stage].values():
+			case['iterations'] = max(1, case['iterations'] // scale)
+
+	spec_file = os.path.join(directory, 'bench_spec.json')
+	with open(spec_file, 'w') as f:
+		json.dump(spec, f, indent='\t')
+
+	transformer = os.path.join(directory, 'transformer.cpp')
+	run([sys.executable, 'scripts/auto_gen_transformer.py', '--input', spec_file, '--output', transformer],
+		stdout=subprocess.DEVNULL)
+
+	binary = os.path.join(directory, 'main')
+	run([cxx, '-o', binary] + cxxflags.split() + ['-I.', 'main.cpp', transformer, 'transform_batch.cpp', 'lock_profile.cpp'])
+	return spec, binary
+
+def generate_input(spec, workload, n, directory):
+	spec = copy.deepcopy(spec)
+	spec['n'] = n
+	spec['auto_gen_input']['choices'] = {str(n): WORKLOADS[workload]}
+
+	spec_file = os.path.join(directory, f'{workload}_{n}_spec.json')
+	with open(spec_file, 'w') as f:
+		json.dump(spec, f, indent='\t')
+
+	input_file = os.path.join(directory, f'{workload}_{n}.in')
+	run([sys.executable, 'scripts/auto_gen_input.py', '--input', spec_file, '--output', input_file],
+		stdout=subprocess.DEVNULL)
+	return input_file
+
+def digest(output_file):
+	with open(output_file, 'rb') as f:
+		return hashlib.md5(b''.join(sorted(f.readlines()))).hexdigest()
+
+def in_key_order(output_file):
+	with open(output_file, 'r') as f:
+		keys = [int(line.split()[0]) for line in f]
+	return keys == sorted(keys)
+
+def measure(binary, n, input_file, output_file, telemetry_file, options):
+	before = resource.getrusage(resource.RUSAGE_CHILDREN)
+	begin = time.monotonic()
+	run([binary, str(n), input_file, output_file, '--telemetry', telemetry_file] + options,
+		stdout=subprocess.DEVNULL)
+	wall = time.monotonic() - begin
+	after = resource.getrusage(resource.RUSAGE_CHILDREN)
+
+	with open(telemetry_file, 'r') as f:
+		last = json.loads(f.readlines()[-1])
+
+	cpu = (after.ru_utime - before.ru_utime) + (after.ru_stime - before.ru_stime)
+	busy = sum(thread['busy_s'] for thread in last['threads'].values())
+	return {
+		'wall_s': round(wall, 6),
+		'items_per_s': round(n / wall, 1),
+		'p50_us': last['latency']['p50_us'],
+		'p99_us': last['latency']['p99_us'],
+		'cpu_s': round(cpu, 6),
+		# the share of the machine the run kept busy
+		'cpu_utilization': round(cpu / (wall * os.cpu_count()), 4),
+		# the items per second of CPU time: the throughput the run would
+		# have if it were alone on one CPU
+		'items_per_cpu_s': round(n / cpu, 1) if cpu > 0 else 0,
+		# the time the threads spent on the items, summed over the threads;
+		# a wall clock time, so it includes preemption on a busy machine
+		'busy_s': round(busy, 6),
+	}
+
+@click.command()
+@click.option('--spec', default='./tests/01_spec.json', help='The spec of the shared transformer.')
+@click.option('--scale', default=1000, help='Divide the iterations of the spec by this.')
+@click.option('--workloads', default=','.join(WORKLOADS), help='Comma-separated workloads.')
+@click.option('--sizes', default='10000', help='Comma-separated numbers of items.')
+@click.option('--queue-types', default='ts,lockfree,stealing', help='Comma-separated input and worker queue types.')
+@click.option('--queue-sizes', default='50,200,1000', help='Comma-separated input and worker queue sizes.')
+@click.option('--output-queues', default='ts',
+	help='Comma-separated output queue types, "ordered" for the output in key order.')
+@click.option('--producers', default='2,4', help='Comma-separated numbers of producers.')
+@click.option('--consumers', default='4,16', help='Comma-separated sizes of the consumer pool.')
+@click.option('--scaling', default='pid', help='The scaling policy of main.')
+@click.option('--placements', default='none,llc,core',
+	help='Comma-separated thread placements of main, "none" for the threads unpinned.')
+@click.option('--check-period', default=10000, help='The check period of the controllers in microseconds.')
+@click.option('--transform', default='iterative', help='The transform mode of main.')
+@click.option('--repeat', default=1, help='Runs of every configuration.')
+@click.option('--quick', is_flag=True, help='One small configuration per workload.')
+@click.option('--dir', 'directory', default='./bench', help='Where the workloads and the builds go.')
+@click.option('--output', default='./bench/results.csv', help='The results, CSV or JSON lines for a .json name.')
+@click.option('--cxx', default='g++', help='The compiler to build main with.')
+@click.option('--cxxflags', default='-static -std=c++11 -O3 -pthread', help='The flags to build main with.')
+def bench(spec, scale, workloads, sizes, queue_types, queue_sizes, output_queues, producers, consumers, scaling, placements,
+	check_period, transform, repeat, quick, directory, output, cxx, cxxflags):
+	if quick:
+		sizes, queue_types, queue_sizes, producers, consumers = '2000', 'ts', '200', '4', '16'
+
+	os.makedirs(directory, exist_ok=True)
+	with open(spec, 'r') as f:
+		spec = json.load(f)
+	spec, binary = build(spec, scale, directory, cxx, cxxflags)
+
+	rows = []
+	for workload, n in itertools.product(split(workloads), split(sizes, int)):
+		input_file = generate_input(spec, workload, n, directory)
+		output_file = os.path.join(directory, 'bench.out')
+		telemetry_file = os.path.join(directory, 'telemetry.json')
+
+		# the output of the defaults is the reference of every other run
+		measure(binary, n, input_file, output_file, telemetry_file, ['--transform', transform])
+		reference = digest(output_file)
+
+		sweep = itertools.product(split(queue_types), split(queue_sizes, int), split(output_queues),
+			split(producers, int), split(consumers, int), split(placements), range(repeat))
+		for queue_type, queue_size, output_queue, num_producers, max_consumers, placement, index in sweep:
+			options = [
+				'--input-queue', queue_type, '--worker-queue', queue_type, '--output-queue', output_queue,
+				'--input-queue-size', str(queue_size), '--worker-queue-size', str(queue_size),
+				'--producers', str(num_producers), '--max-consumers', str(max_consumers),
+				'--scaling', scaling, '--check-period', str(check_period),
+				'--transform', transform, '--placement', placement,
+			]
+			row = {
+				'workload': workload, 'n': n, 'queue_type': queue_type, 'queue_size': queue_size,
+				'output_queue': output_queue, 'producers': num_producers, 'max_consumers': max_consumers, 'scaling': scaling,
+				'placement': placement, 'run': index,
+			}
+			row.update(measure(binary, n, input_file, output_file, telemetry_file, options))
+			row['ok'] = digest(output_file) == reference and (output_queue != 'ordered' or in_key_order(output_file))
+			rows.append(row)
+			print(json.dumps(row), file=sys.stderr)
+
+	with open(output, 'w') as f:
+		if output.endswith('.json'):
+			for row in rows:
+				print(json.dumps(row), file=f)
+		else:
+			writer = csv.DictWriter(f, fieldnames=FIELDS)
+			writer.writeheader()
+			writer.writerows(rows)
+
+	failed = sum(not row['ok'] for row in rows)
+	color = '\033[1;31;48m' if failed else '\033[1;32;48m'
+	print('\n' + color + f'done: {len(rows)} runs, {failed} wrong outputs [{output}].' + '\033[1;37;0m')
+	sys.exit(1 if failed else 0)
+
+if __name__ == '__main__':
+	bench()
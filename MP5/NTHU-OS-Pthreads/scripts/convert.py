@@ -0,0 +1,53 @@
+import click
+import struct
+
+# The binary format of record.hpp: a header of the magic, the version and the
+# record size, then one little-endian record per item: val (u64), key (i32),
+# opcode (a byte) and three zero bytes.
+MAGIC = b'NTHUITEM'
+VERSION = 1
+HEADER = struct.Struct('<8sII')
+RECORD = struct.Struct('<QiB3x')
+
+def is_binary(path):
+	with open(path, 'rb') as f:
+		head = f.read(HEADER.size)
+	return len(head) == HEADER.size and HEADER.unpack(head) == (MAGIC, VERSION, RECORD.size)
+
+def read_lines(path):
+	"""the items of a text or binary file as "key val opcode\\n" lines"""
+	if not is_binary(path):
+		with open(path, 'r') as f:
+			return f.readlines()
+
+	with open(path, 'rb') as f:
+		data = f.read()
+	lines = []
+	for offset in range(HEADER.size, len(data) - RECORD.size + 1, RECORD.size):
+		val, key, opcode = RECORD.unpack_from(data, offset)
+		lines.append(f'{key} {val} {chr(opcode)}\n')
+	return lines
+
+def write_binary(lines, path):
+	with open(path, 'wb') as f:
+		f.write(HEADER.pack(MAGIC, VERSION, RECORD.size))
+		for line in lines:
+			key, val, opcode = line.split()
+			f.write(RECORD.pack(int(val), int(key), ord(opcode)))
+
+@click.command()
+@click.option('--input', required=True, help='Input file path, text or binary.')
+@click.option('--output', required=True, help='Output file path.')
+@click.option('--to', 'to', type=click.Choice(['binary', 'text']), default='binary', help='The format of the output.')
+def convert(input, output, to):
+	lines = [line for line in read_lines(input) if line.strip()]
+	if to == 'binary':
+		write_binary(lines, output)
+	else:
+		with open(output, 'w') as f:
+			f.writelines(lines)
+
+	print('\033[1;32;48m' + f'converted {len(lines)} items to {to}' + '\033[1;37;0m')
+
+if __name__ == '__main__':
+	convert()
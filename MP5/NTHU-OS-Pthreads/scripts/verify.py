@@ -1,14 +1,20 @@
 # Copyright (C) 2021 justin0u0<mail@justin0u0.com>
 
 import click
+from convert import read_lines
 
 @click.command()
-@click.option('--output', default='./transformer.cpp', help='Output file path.')
+@click.option('--output', default='./transformer.cpp', help='Output file path, text or binary (--writer binary).')
 @click.option('--answer', default='./tests/00_spec.json', help='Answer file path.')
-def verify(output, answer):
-	with open(output, 'r') as output_f, open(answer, 'r') as answer_f:
-		output_lines = sorted(output_f.readlines())
+@click.option('--ordered', is_flag=True, help='The output is in key order (--output-queue ordered), compare without sorting it.')
+def verify(output, answer, ordered):
+	with open(answer, 'r') as answer_f:
+		output_lines = read_lines(output)
 		answer_lines = sorted(answer_f.readlines())
+		if ordered:
+			answer_lines.sort(key=lambda line: int(line.split()[0]))
+		else:
+			output_lines.sort()
 
 		for output_line, answer_line in zip(output_lines, answer_lines):
 			if output_line != answer_line:
@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include "writer.hpp"
+#include "record.hpp"
+
+#ifndef SHARD_HPP
+#define SHARD_HPP
+
+// A part of the input for a pipeline of its own: the bytes [begin, end) of
+// the input file, lines of items starting at line first_line (counting from 1).
+// In a file of records (record.hpp) the lines are records.
+struct InputShard {
+	size_t begin;
+	size_t end;
+	int lines;
+	int first_line;
+};
+
+enum MergeOrder {
+	// the parts one after the other, each in the order it was written
+	MERGE_ARRIVAL,
+	// a k-way merge by key, every part has to be in key order
+	MERGE_KEY
+};
+
+// Split the first n lines of input_file into count shards at line
+// boundaries, of about the same number of bytes, or at record boundaries.
+// A file of fewer than n lines is split into the lines there are, and the
+// shards that would be empty are left out: there are fewer than count shards
+// with fewer lines than count, and one empty shard without any. Returns no
+// shard and prints why if the file cannot be read.
+std::vector<InputShard> split_input(std::string input_file, int n, int count);
+
+// Merge the part files into output_file, all of lines or all of records,
+// returns false and prints why if a
+// file cannot be read or written.
+bool merge_parts(const std::vector<std::string>& parts, std::string output_file, MergeOrder order);
+
+// Implementation start
+
+std::vector<InputShard> split_input(std::string input_file, int n, int count) {
+	std::vector<InputShard> shards;
+
+	int fd = open(input_file.c_str(), O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "cannot open the input %s\n", input_file.c_str());
+		return shards;
+	}
+	struct stat st;
+	fstat(fd, &st);
+	size_t size = st.st_size;
+	const char* data = nullptr;
+	if (size > 0) {
+		void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (addr == MAP_FAILED) {
+			fprintf(stderr, "cannot map the input %s\n", input_file.c_str());
+			close(fd);
+			return shards;
+		}
+		data = (const char*)addr;
+	}
+	close(fd);
+
+	if (is_record_file(data, size)) {
+		int records = std::min(n, (int)((size - sizeof(RecordHeader)) / sizeof(Record)));
+		int first = 0;
+		for (int i = 0; i < count; i++) {
+			int last = (long long)records * (i + 1) / count;
+			if (last > first || (i == count - 1 && shards.empty()))
+				shards.push_back(InputShard{sizeof(RecordHeader) + first * sizeof(Record),
+					sizeof(RecordHeader) + last * sizeof(Record), last - first, first + 1});
+			first = last;
+		}
+		munmap((void*)data, size);
+		return shards;
+	}
+
+	// the bytes of the first n lines
+	size_t end = 0;
+	for (int line = 0; line < n && end < size; line++) {
+		const char* newline = (const char*)memchr(data + end, '\n', size - end);
+		end = newline ? newline - data + 1 : size;
+	}
+
+	size_t begin = 0;
+	int first_line = 1;
+	for (int i = 0; i < count; i++) {
+		// every shard but the last ends right after a newline
+		size_t shard_end = end;
+		if (i < count - 1) {
+			shard_end = std::max(begin, end * (i + 1) / count);
+			while (shard_end < end && shard_end > 0 && data[shard_end - 1] != '\n')
+				shard_end++;
+		}
+
+		int lines = 0;
+		for (size_t p = begin; p < shard_end; lines++) {
+			const char* newline = (const char*)memchr(data + p, '\n', shard_end - p);
+			p = newline ? newline - data + 1 : shard_end;
+		}
+
+		if (lines > 0 || (i == count - 1 && shards.empty()))
+			shards.push_back(InputShard{begin, shard_end, lines, first_line});
+		begin = shard_end;
+		first_line += lines;
+	}
+
+	if (data)
+		munmap((void*)data, size);
+	return shards;
+}
+
+// a part file mapped for the merge, and the next line or record in it
+struct MergePart {
+	const char* data;
+	size_t size;
+	size_t line;
+	bool records;
+};
+
+// the key of the next line or record of part
+static inline int merge_key(const MergePart& part) {
+	if (part.records) {
+		Item item;
+		read_record(part.data + part.line, &item);
+		return item.key;
+	}
+	return (int)strtol(part.data + part.line, nullptr, 10);
+}
+
+// where the next line or record of part ends
+static inline size_t merge_next(const MergePart& part) {
+	if (part.records)
+		return part.line + sizeof(Record);
+	const char* newline = (const char*)memchr(part.data + part.line, '\n', part.size - part.line);
+	return newline ? newline - part.data + 1 : part.size;
+}
+
+// the output of the merge, written out WRITER_BUFFER_SIZE bytes at a time
+struct MergeOutput {
+	int fd;
+	char* buffer;
+	size_t used;
+
+	void flush() {
+		for (size_t done = 0; done < used; ) {
+			ssize_t written = write(fd, buffer + done, used - done);
+			assert(written > 0);
+			done += written;
+		}
+		used = 0;
+	}
+
+	void append(const char* p, size_t length) {
+		while (length > 0) {
+			if (used == WRITER_BUFFER_SIZE)
+				flush();
+			size_t count = std::min(length, (size_t)WRITER_BUFFER_SIZE - used);
+			memcpy(buffer + used, p, count);
+			used += count;
+			p += count;
+			length -= count;
+		}
+	}
+};
+
+bool merge_parts(const std::vector<std::string>& parts, std::string output_file, MergeOrder order) {
+	std::vector<MergePart> mapped;
+	bool ok = true;
+	for (const std::string& name : parts) {
+		int fd = open(name.c_str(), O_RDONLY);
+		if (fd < 0) {
+			fprintf(stderr, "cannot open the part %s\n", name.c_str());
+			ok = false;
+			break;
+		}
+		struct stat st;
+		fstat(fd, &st);
+		MergePart part = {nullptr, (size_t)st.st_size, 0, false};
+		if (part.size > 0) {
+			void* addr = mmap(nullptr, part.size, PROT_READ, MAP_PRIVATE, fd, 0);
+			assert(addr != MAP_FAILED);
+			madvise(addr, part.size, MADV_SEQUENTIAL);
+			part.data = (const char*)addr;
+		}
+		close(fd);
+		// the header is written once, before the records of every part
+		if (is_record_file(part.data, part.size)) {
+			part.records = true;
+			part.line = sizeof(RecordHeader);
+		}
+		mapped.push_back(part);
+	}
+
+	MergeOutput out = {-1, nullptr, 0};
+	if (ok) {
+		out.fd = open(output_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (out.fd < 0) {
+			fprintf(stderr, "cannot open the output %s\n", output_file.c_str());
+			ok = false;
+		}
+	}
+
+	if (ok) {
+		out.buffer = new char[WRITER_BUFFER_SIZE];
+		if (!mapped.empty() && mapped[0].records)
+			out.used = write_record_header(out.buffer) - out.buffer;
+		if (order == MERGE_ARRIVAL) {
+			for (MergePart& part : mapped)
+				out.append(part.data + part.line, part.size - part.line);
+		} else {
+			// the parts by the key of their next line, the smallest first
+			std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int> >,
+				std::greater<std::pair<int, int> > > heads;
+			for (size_t i = 0; i < mapped.size(); i++)
+				if (mapped[i].line < mapped[i].size)
+					heads.push(std::make_pair(merge_key(mapped[i]), (int)i));
+
+			while (!heads.empty()) {
+				int i = heads.top().second;
+				heads.pop();
+
+				MergePart& part = mapped[i];
+				size_t next = merge_next(part);
+				out.append(part.data + part.line, next - part.line);
+				part.line = next;
+
+				if (part.line < part.size)
+					heads.push(std::make_pair(merge_key(part), i));
+			}
+		}
+		out.flush();
+		close(out.fd);
+		delete[] out.buffer;
+	}
+
+	for (MergePart& part : mapped)
+		if (part.data)
+			munmap((void*)part.data, part.size);
+	return ok;
+}
+
+#endif // SHARD_HPP
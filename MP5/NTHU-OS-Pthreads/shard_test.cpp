@@ -0,0 +1,88 @@
+#include <assert.h>
+#include <stdio.h>
+#include <fstream>
+#include "shard.hpp"
+
+// the shards of the first 50 lines of a file of only 20 lines or records:
+// however many are asked for, they hold the 20 there are, none of them empty
+void test_short_input(std::string file, bool records) {
+	FILE* out = fopen(file.c_str(), "w");
+	char buffer[64];
+	if (records)
+		fwrite(buffer, write_record_header(buffer) - buffer, 1, out);
+	for (int key = 1; key <= 20; key++) {
+		Item item(key, key * 10, 'A');
+		if (records)
+			fwrite(buffer, write_record(buffer, item) - buffer, 1, out);
+		else
+			fprintf(out, "%d %d A\n", key, key * 10);
+	}
+	fclose(out);
+
+	int counts[] = {3, 20, 30};
+	for (int count : counts) {
+		std::vector<InputShard> shards = split_input(file, 50, count);
+		// the lines are split by bytes, two can fall in one shard and none in the next
+		int most = std::min(count, 20);
+		assert(records ? (int)shards.size() == most : (int)shards.size() <= most);
+		int lines = 0;
+		for (InputShard& shard : shards) {
+			assert(shard.lines > 0 && shard.first_line == lines + 1);
+			lines += shard.lines;
+		}
+		assert(lines == 20);
+	}
+
+	// no line, one empty shard
+	std::vector<InputShard> shards = split_input(file, 0, 4);
+	assert(shards.size() == 1 && shards[0].lines == 0);
+	remove(file.c_str());
+}
+
+int main() {
+	test_short_input("./tests/shard_test.in", false);
+	test_short_input("./tests/shard_test.bin", true);
+
+	// split the first 1000 lines of the input into 4 shards and merge the
+	// shards back by key, as if each had been written out by a pipeline
+	std::vector<InputShard> shards = split_input("./tests/01.in", 1000, 4);
+	assert(shards.size() == 4);
+
+	std::vector<std::string> parts;
+	int lines = 0;
+	for (size_t i = 0; i < shards.size(); i++) {
+		printf("shard %zu: bytes [%zu, %zu), %d lines from line %d\n", i, shards[i].begin, shards[i].end,
+			shards[i].lines, shards[i].first_line);
+		assert(shards[i].first_line == lines + 1);
+		assert(i == 0 || shards[i].begin == shards[i - 1].end);
+		lines += shards[i].lines;
+
+		parts.push_back("./tests/01.in.part" + std::to_string(i));
+		FILE* in = fopen("./tests/01.in", "r");
+		FILE* out = fopen(parts.back().c_str(), "w");
+		fseek(in, shards[i].begin, SEEK_SET);
+		for (size_t b = shards[i].begin; b < shards[i].end; b++)
+			fputc(fgetc(in), out);
+		fclose(in);
+		fclose(out);
+	}
+	assert(lines == 1000);
+
+	std::string merged_file = "./tests/01.merged.out";
+	bool merged = merge_parts(parts, merged_file, MERGE_KEY);
+	assert(merged);
+	for (std::string& part : parts)
+		remove(part.c_str());
+
+	// the first 1000 lines of the input, which are in key order
+	std::ifstream input("./tests/01.in"), output(merged_file);
+	std::string expected, line;
+	for (int i = 0; i < 1000; i++) {
+		assert(std::getline(input, expected) && std::getline(output, line));
+		assert(line == expected);
+	}
+	assert(!std::getline(output, line));
+	remove(merged_file.c_str());
+
+	return 0;
+}
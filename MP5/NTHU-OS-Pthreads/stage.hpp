@@ -0,0 +1,213 @@
+#include <pthread.h>
+#include <atomic>
+#include "thread.hpp"
+#include "queue.hpp"
+#include "stats.hpp"
+#include "lock_profile.hpp"
+
+#ifndef STAGE_HPP
+#define STAGE_HPP
+
+// A thread of the pipeline: it pulls up to batch_size inputs, turns them
+// into outputs with work and pushes the outputs on, until pull runs dry.
+// By default pull takes from the input queue and push hands to the output
+// queue; a source stage (no input queue) overrides pull and a sink stage
+// (no output queue) overrides push or just returns no outputs from work.
+// A stage can be parked between batches by cancel and woken up by resume,
+// which is how the controllers scale a pool of stages.
+template <typename In, typename Out>
+class Stage : public Thread {
+public:
+	// constructor, either queue may be nullptr for a source or a sink
+	Stage(Queue<In>* input_queue, Queue<Out>* output_queue, int batch_size = 1);
+
+	// destructor
+	virtual ~Stage();
+
+	virtual void start() override;
+
+	// park the stage: it finishes the batch in hand and sleeps until resume,
+	// a stage blocked on an empty input queue is woken up to park at once
+	virtual int cancel() override;
+
+	// unpark a stage parked by cancel
+	void resume();
+
+	// let the thread return instead of parking, and wait for it
+	void stop();
+
+	// whether the thread is sleeping in park right now
+	bool is_parked();
+
+	// the inputs worked on so far and the time it took
+	ServiceStats& get_stats();
+protected:
+	Queue<In>* input_queue;
+	Queue<Out>* output_queue;
+
+	// the maximum number of items moved per queue operation
+	int batch_size;
+
+	// what the thread is to the lock profiles of the queues, set by the stage constructor
+	ThreadRole role;
+
+	// set by cancel and cleared by resume, checked between batches
+	// and by the input queue while it waits
+	std::atomic<bool> is_cancel;
+
+	// called on the stage thread before the first and after the last batch
+	virtual void begin() {}
+	virtual void finish() {}
+
+	// take up to max inputs, 0 if cancelled while waiting for them
+	// and -1 once there will be no more
+	virtual int pull(In* items, int max);
+
+	// turn the n inputs into at most batch_size outputs, return how many
+	virtual int work(In* items, int n, Out* outputs) = 0;
+
+	// hand the n outputs to the next stage
+	virtual void push(Out* items, int n);
+private:
+	std::atomic<bool> is_stop;
+	std::atomic<bool> parked;
+
+	pthread_mutex_t park_mutex;
+	pthread_cond_t park_cond;
+
+	ServiceStats stats;
+
+	// sleep while cancelled, returns false once the stage is stopped
+	bool park();
+
+	// the method for pthread to create a stage thread
+	static void* process(void* arg);
+};
+
+// Implementation start
+
+template <typename In, typename Out>
+Stage<In, Out>::Stage(Queue<In>* input_queue, Queue<Out>* output_queue, int batch_size)
+	: input_queue(input_queue), output_queue(output_queue), batch_size(batch_size), role(ROLE_OTHER) {
+	is_cancel = false;
+	is_stop = false;
+	parked = false;
+
+	pthread_mutex_init(&park_mutex, nullptr);
+	pthread_cond_init(&park_cond, nullptr);
+}
+
+template <typename In, typename Out>
+Stage<In, Out>::~Stage() {
+	pthread_mutex_destroy(&park_mutex);
+	pthread_cond_destroy(&park_cond);
+}
+
+template <typename In, typename Out>
+void Stage<In, Out>::start() {
+	create(Stage::process, (void*)this);
+}
+
+template <typename In, typename Out>
+int Stage<In, Out>::cancel() {
+	is_cancel = true;
+	if (input_queue)
+		input_queue->wake_dequeuers();
+	return is_cancel;
+}
+
+template <typename In, typename Out>
+void Stage<In, Out>::resume() {
+	pthread_mutex_lock(&park_mutex);
+	is_cancel = false;
+	pthread_cond_signal(&park_cond);
+	pthread_mutex_unlock(&park_mutex);
+}
+
+template <typename In, typename Out>
+void Stage<In, Out>::stop() {
+	pthread_mutex_lock(&park_mutex);
+	is_stop = true;
+	is_cancel = true;
+	pthread_cond_signal(&park_cond);
+	pthread_mutex_unlock(&park_mutex);
+
+	if (input_queue)
+		input_queue->wake_dequeuers();
+	join();
+}
+
+template <typename In, typename Out>
+bool Stage<In, Out>::is_parked() {
+	return parked;
+}
+
+template <typename In, typename Out>
+ServiceStats& Stage<In, Out>::get_stats() {
+	return stats;
+}
+
+template <typename In, typename Out>
+bool Stage<In, Out>::park() {
+	pthread_mutex_lock(&park_mutex);
+	parked = true;
+	while (is_cancel && !is_stop) {
+		pthread_cond_wait(&park_cond, &park_mutex);
+	}
+	parked = false;
+	pthread_mutex_unlock(&park_mutex);
+
+	return !is_stop;
+}
+
+template <typename In, typename Out>
+int Stage<In, Out>::pull(In* items, int max) {
+	return input_queue->dequeue_bulk(items, max, &is_cancel);
+}
+
+template <typename In, typename Out>
+void Stage<In, Out>::push(Out* items, int n) {
+	if (output_queue && n > 0)
+		output_queue->enqueue_bulk(items, n);
+}
+
+template <typename In, typename Out>
+void* Stage<In, Out>::process(void* arg) {
+	Stage* stage = (Stage*)arg;
+	thread_role = stage->role;
+	// A cancellation request is deferred until the thread next calls
+	// a function that is a cancellation point
+	pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, nullptr);
+
+	stage->begin();
+
+	In* items = new In[stage->batch_size];
+	Out* outputs = new Out[stage->batch_size];
+
+	while (!stage->is_cancel || stage->park()) {
+		// not cancelled in the middle of a batch
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, nullptr);
+
+		int n = stage->pull(items, stage->batch_size);
+		if (n < 0) {
+			pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, nullptr);
+			break;
+		}
+
+		long long begin = now_ns();
+		int m = stage->work(items, n, outputs);
+		stage->stats.record(n, now_ns() - begin);
+		stage->push(outputs, m);
+
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, nullptr);
+	}
+
+	delete[] items;
+	delete[] outputs;
+
+	stage->finish();
+
+	return nullptr;
+}
+
+#endif // STAGE_HPP
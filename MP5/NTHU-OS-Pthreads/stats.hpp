@@ -0,0 +1,137 @@
+#include <time.h>
+#include <atomic>
+#include <algorithm>
+#include <vector>
+
+#ifndef STATS_HPP
+#define STATS_HPP
+
+// the number of power-of-two buckets of a Histogram
+#define HISTOGRAM_BUCKETS 40
+
+// the monotonic clock in nanoseconds
+static inline long long now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Counts of values in power-of-two buckets: bucket 0 holds 0 and bucket i
+// holds [2^(i-1), 2^i). The buckets are relaxed atomics, so one thread can
+// record while another reads.
+struct Histogram {
+	std::atomic<long long> buckets[HISTOGRAM_BUCKETS];
+	std::atomic<long long> count;
+	std::atomic<long long> sum;
+	std::atomic<long long> max;
+
+	Histogram() : count(0), sum(0), max(0) {
+		for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+			buckets[i].store(0, std::memory_order_relaxed);
+	}
+
+	void record(long long value) {
+		int bucket = value <= 0 ? 0 : 64 - __builtin_clzll((unsigned long long)value);
+		if (bucket >= HISTOGRAM_BUCKETS)
+			bucket = HISTOGRAM_BUCKETS - 1;
+		buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+		count.fetch_add(1, std::memory_order_relaxed);
+		sum.fetch_add(value, std::memory_order_relaxed);
+
+		long long old = max.load(std::memory_order_relaxed);
+		while (value > old && !max.compare_exchange_weak(old, value, std::memory_order_relaxed))
+			;
+	}
+
+	// the upper bound of the bucket holding the p-th fraction of the values,
+	// or the largest value if that is smaller
+	long long percentile(double p) {
+		long long total = count.load(std::memory_order_relaxed);
+		long long largest = max.load(std::memory_order_relaxed);
+		long long seen = 0;
+		for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+			seen += buckets[i].load(std::memory_order_relaxed);
+			if (total > 0 && seen >= p * total)
+				return std::min(i == 0 ? 0 : (1LL << i) - 1, largest);
+		}
+		return largest;
+	}
+
+	double mean() {
+		long long total = count.load(std::memory_order_relaxed);
+		return total > 0 ? (double)sum.load(std::memory_order_relaxed) / total : 0;
+	}
+};
+
+// the work a thread has done so far, read by the controllers and the telemetry
+struct ServiceStats {
+	std::atomic<long long> items;
+	// the time spent working on the items, without the queue waits
+	std::atomic<long long> busy_ns;
+
+	ServiceStats() : items(0), busy_ns(0) {}
+
+	void record(int n, long long ns) {
+		items.fetch_add(n, std::memory_order_relaxed);
+		busy_ns.fetch_add(ns, std::memory_order_relaxed);
+	}
+};
+
+// what went through a queue, recorded by the queue once set_stats is called
+struct QueueStats {
+	std::atomic<long long> enqueued;
+	std::atomic<long long> dequeued;
+	// the time threads spent blocked on a full or an empty queue
+	std::atomic<long long> enqueue_wait_ns;
+	std::atomic<long long> dequeue_wait_ns;
+	// the number of elements in the queue after every operation
+	Histogram depth;
+
+	QueueStats() : enqueued(0), dequeued(0), enqueue_wait_ns(0), dequeue_wait_ns(0) {}
+
+	void record_enqueue(int n, int size) {
+		enqueued.fetch_add(n, std::memory_order_relaxed);
+		depth.record(size);
+	}
+
+	void record_dequeue(int n, int size) {
+		dequeued.fetch_add(n, std::memory_order_relaxed);
+		depth.record(size);
+	}
+};
+
+// what a cache of results saw, recorded by the cache
+struct CacheStats {
+	std::atomic<long long> hits;
+	std::atomic<long long> misses;
+	// the entries replaced by others for lack of room
+	std::atomic<long long> evictions;
+
+	CacheStats() : hits(0), misses(0), evictions(0) {}
+
+	void record(int hit, int missed) {
+		hits.fetch_add(hit, std::memory_order_relaxed);
+		misses.fetch_add(missed, std::memory_order_relaxed);
+	}
+};
+
+// when the Reader read each item (now_ns), by key, for the end-to-end latency
+// the Writer records. Kept out of the Items so they stay 16 bytes; the keys
+// out of range are not timed. The queue between the two orders the accesses.
+struct ReadTimes {
+	std::vector<long long> times;
+
+	explicit ReadTimes(int keys) : times(keys, 0) {}
+
+	void stamp(int key, long long now) {
+		if (key >= 0 && key < (int)times.size())
+			times[key] = now;
+	}
+
+	// the time key was read, 0 if it was not timed
+	long long get(int key) {
+		return key >= 0 && key < (int)times.size() ? times[key] : 0;
+	}
+};
+
+#endif // STATS_HPP
@@ -0,0 +1,285 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "thread.hpp"
+#include "stats.hpp"
+
+#ifndef TELEMETRY_HPP
+#define TELEMETRY_HPP
+
+// Samples the stats of the queues, the threads and the caches of the pipeline every
+// period and appends them to a file: CSV rows of "time,name,metric,value",
+// or one JSON object per sample when the file name ends with ".json".
+// All the stats are relaxed atomics updated by their own threads, so the
+// telemetry only ever reads them.
+class Telemetry : public Thread {
+public:
+	// constructor, period in microseconds,
+	// the times in the samples count from here
+	Telemetry(std::string output_file, int period);
+
+	// destructor
+	~Telemetry();
+
+	// register what to sample, before start
+	void add_queue(std::string name, QueueStats* stats);
+	void add_thread(std::string name, ServiceStats* stats);
+	void add_cache(std::string name, CacheStats* stats);
+
+	// the end-to-end latency of the items in microseconds, recorded by the Writer
+	Histogram* get_latency();
+
+	virtual void start() override;
+
+	// write a last sample and stop the sampling thread
+	void stop();
+
+	// print the totals since start
+	void print_summary(FILE* out);
+private:
+	struct QueueEntry {
+		std::string name;
+		QueueStats* stats;
+	};
+
+	struct ThreadEntry {
+		std::string name;
+		ServiceStats* stats;
+		// the busy time at the previous sample
+		long long last_busy_ns;
+	};
+
+	struct CacheEntry {
+		std::string name;
+		CacheStats* stats;
+	};
+
+	FILE* file;
+	bool json;
+	int period;
+
+	std::vector<QueueEntry> queues;
+	std::vector<ThreadEntry> threads;
+	std::vector<CacheEntry> caches;
+	Histogram latency;
+
+	long long start_ns;
+	long long last_sample_ns;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool is_stop;
+
+	// append one sample to the file
+	void sample();
+
+	// the method for pthread to create the sampling thread
+	static void* process(void* arg);
+};
+
+// Implementation start
+
+Telemetry::Telemetry(std::string output_file, int period) : period(period), start_ns(now_ns()),
+	last_sample_ns(start_ns), is_stop(false) {
+	file = fopen(output_file.c_str(), "w");
+	assert(file);
+
+	json = output_file.size() >= 5 && output_file.compare(output_file.size() - 5, 5, ".json") == 0;
+	if (!json)
+		fprintf(file, "time,name,metric,value\n");
+
+	pthread_mutex_init(&mutex, nullptr);
+	pthread_cond_init(&cond, nullptr);
+}
+
+Telemetry::~Telemetry() {
+	fclose(file);
+	pthread_mutex_destroy(&mutex);
+	pthread_cond_destroy(&cond);
+}
+
+void Telemetry::add_queue(std::string name, QueueStats* stats) {
+	queues.push_back(QueueEntry{name, stats});
+}
+
+void Telemetry::add_thread(std::string name, ServiceStats* stats) {
+	threads.push_back(ThreadEntry{name, stats, 0});
+}
+
+void Telemetry::add_cache(std::string name, CacheStats* stats) {
+	caches.push_back(CacheEntry{name, stats});
+}
+
+Histogram* Telemetry::get_latency() {
+	return &latency;
+}
+
+void Telemetry::start() {
+	create(Telemetry::process, (void*)this);
+}
+
+void Telemetry::stop() {
+	pthread_mutex_lock(&mutex);
+	is_stop = true;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&mutex);
+	join();
+
+	sample();
+	fflush(file);
+}
+
+void Telemetry::sample() {
+	long long now = now_ns();
+	double time = (now - start_ns) / 1e9;
+	double interval = (now - last_sample_ns) / 1e9;
+	last_sample_ns = now;
+
+	if (json)
+		fprintf(file, "{\"time\":%.6f,\"queues\":{", time);
+	for (size_t i = 0; i < queues.size(); i++) {
+		QueueStats* stats = queues[i].stats;
+		long long values[] = {
+			stats->enqueued.load(std::memory_order_relaxed),
+			stats->dequeued.load(std::memory_order_relaxed),
+			stats->enqueued.load(std::memory_order_relaxed) - stats->dequeued.load(std::memory_order_relaxed),
+			stats->enqueue_wait_ns.load(std::memory_order_relaxed) / 1000,
+			stats->dequeue_wait_ns.load(std::memory_order_relaxed) / 1000,
+			stats->depth.percentile(0.5),
+			stats->depth.percentile(0.99),
+			stats->depth.max.load(std::memory_order_relaxed)
+		};
+		const char* metrics[] = {"enqueued", "dequeued", "size", "enqueue_wait_us", "dequeue_wait_us",
+			"depth_p50", "depth_p99", "depth_max"};
+
+		if (json)
+			fprintf(file, "%s\"%s\":{", i ? "," : "", queues[i].name.c_str());
+		for (int m = 0; m < 8; m++) {
+			if (json)
+				fprintf(file, "%s\"%s\":%lld", m ? "," : "", metrics[m], values[m]);
+			else
+				fprintf(file, "%.6f,%s,%s,%lld\n", time, queues[i].name.c_str(), metrics[m], values[m]);
+		}
+		if (json)
+			fprintf(file, "}");
+	}
+
+	if (json)
+		fprintf(file, "},\"threads\":{");
+	for (size_t i = 0; i < threads.size(); i++) {
+		long long items = threads[i].stats->items.load(std::memory_order_relaxed);
+		long long busy_ns = threads[i].stats->busy_ns.load(std::memory_order_relaxed);
+		// the fraction of the interval the thread was busy, the rest it was idle
+		double busy = interval > 0 ? (busy_ns - threads[i].last_busy_ns) / 1e9 / interval : 0;
+		threads[i].last_busy_ns = busy_ns;
+
+		if (json) {
+			fprintf(file, "%s\"%s\":{\"items\":%lld,\"busy\":%.4f,\"busy_s\":%.6f}", i ? "," : "",
+				threads[i].name.c_str(), items, busy, busy_ns / 1e9);
+		} else {
+			fprintf(file, "%.6f,%s,items,%lld\n", time, threads[i].name.c_str(), items);
+			fprintf(file, "%.6f,%s,busy,%.4f\n", time, threads[i].name.c_str(), busy);
+			fprintf(file, "%.6f,%s,busy_s,%.6f\n", time, threads[i].name.c_str(), busy_ns / 1e9);
+		}
+	}
+
+	long long latency_values[] = {latency.count.load(std::memory_order_relaxed), latency.percentile(0.5),
+		latency.percentile(0.99), latency.max.load(std::memory_order_relaxed)};
+	const char* latency_metrics[] = {"items", "p50_us", "p99_us", "max_us"};
+	if (json)
+		fprintf(file, "},\"latency\":{");
+	for (int m = 0; m < 4; m++) {
+		if (json)
+			fprintf(file, "%s\"%s\":%lld", m ? "," : "", latency_metrics[m], latency_values[m]);
+		else
+			fprintf(file, "%.6f,latency,%s,%lld\n", time, latency_metrics[m], latency_values[m]);
+	}
+
+	if (json)
+		fprintf(file, "},\"caches\":{");
+	for (size_t i = 0; i < caches.size(); i++) {
+		CacheStats* stats = caches[i].stats;
+		long long values[] = {stats->hits.load(std::memory_order_relaxed),
+			stats->misses.load(std::memory_order_relaxed), stats->evictions.load(std::memory_order_relaxed)};
+		const char* metrics[] = {"hits", "misses", "evictions"};
+
+		if (json)
+			fprintf(file, "%s\"%s\":{", i ? "," : "", caches[i].name.c_str());
+		for (int m = 0; m < 3; m++) {
+			if (json)
+				fprintf(file, "%s\"%s\":%lld", m ? "," : "", metrics[m], values[m]);
+			else
+				fprintf(file, "%.6f,%s,%s,%lld\n", time, caches[i].name.c_str(), metrics[m], values[m]);
+		}
+		if (json)
+			fprintf(file, "}");
+	}
+	if (json)
+		fprintf(file, "}}\n");
+}
+
+void Telemetry::print_summary(FILE* out) {
+	double elapsed = (now_ns() - start_ns) / 1e9;
+	fprintf(out, "telemetry summary over %.3f s\n", elapsed);
+
+	fprintf(out, "%-16s %10s %10s %12s %12s %8s %8s %8s\n", "queue", "enqueued", "dequeued",
+		"enq wait ms", "deq wait ms", "depth50", "depth99", "max");
+	for (QueueEntry& queue : queues) {
+		QueueStats* stats = queue.stats;
+		fprintf(out, "%-16s %10lld %10lld %12.3f %12.3f %8lld %8lld %8lld\n", queue.name.c_str(),
+			stats->enqueued.load(std::memory_order_relaxed),
+			stats->dequeued.load(std::memory_order_relaxed),
+			stats->enqueue_wait_ns.load(std::memory_order_relaxed) / 1e6,
+			stats->dequeue_wait_ns.load(std::memory_order_relaxed) / 1e6,
+			stats->depth.percentile(0.5), stats->depth.percentile(0.99),
+			stats->depth.max.load(std::memory_order_relaxed));
+	}
+
+	fprintf(out, "%-16s %10s %10s %10s %8s\n", "thread", "items", "busy s", "idle s", "busy %");
+	for (ThreadEntry& thread : threads) {
+		double busy = thread.stats->busy_ns.load(std::memory_order_relaxed) / 1e9;
+		fprintf(out, "%-16s %10lld %10.3f %10.3f %7.1f%%\n", thread.name.c_str(),
+			thread.stats->items.load(std::memory_order_relaxed), busy, std::max(0.0, elapsed - busy),
+			elapsed > 0 ? 100 * busy / elapsed : 0);
+	}
+
+	if (!caches.empty())
+		fprintf(out, "%-16s %10s %10s %10s %8s\n", "cache", "hits", "misses", "evictions", "hit %");
+	for (CacheEntry& cache : caches) {
+		long long hits = cache.stats->hits.load(std::memory_order_relaxed);
+		long long misses = cache.stats->misses.load(std::memory_order_relaxed);
+		fprintf(out, "%-16s %10lld %10lld %10lld %7.1f%%\n", cache.name.c_str(), hits, misses,
+			cache.stats->evictions.load(std::memory_order_relaxed),
+			hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0);
+	}
+
+	fprintf(out, "item latency us: mean %.1f p50 %lld p99 %lld max %lld (%lld items)\n", latency.mean(),
+		latency.percentile(0.5), latency.percentile(0.99), latency.max.load(std::memory_order_relaxed),
+		latency.count.load(std::memory_order_relaxed));
+}
+
+void* Telemetry::process(void* arg) {
+	Telemetry* telemetry = (Telemetry*)arg;
+
+	pthread_mutex_lock(&telemetry->mutex);
+	while (!telemetry->is_stop) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		long long nsec = deadline.tv_nsec + telemetry->period * 1000LL;
+		deadline.tv_sec += nsec / 1000000000;
+		deadline.tv_nsec = nsec % 1000000000;
+		pthread_cond_timedwait(&telemetry->cond, &telemetry->mutex, &deadline);
+
+		if (!telemetry->is_stop)
+			telemetry->sample();
+	}
+	pthread_mutex_unlock(&telemetry->mutex);
+
+	return nullptr;
+}
+
+#endif // TELEMETRY_HPP
@@ -1,10 +1,15 @@
 #include <pthread.h>
+#include <sched.h>
+#include <vector>
 
 #ifndef THREAD_HPP
 #define THREAD_HPP
 
 class Thread {
 public:
+	// virtual, deleting a thread through a base pointer runs its own destructor
+	virtual ~Thread() {}
+
 	// to start a new pthread work
 	virtual void start() = 0;
 
@@ -13,8 +18,18 @@ public:
 
 	// to cancel the pthread work
 	virtual int cancel();
+
+	// run only on cpus, before start, see Placement in topology.hpp;
+	// no cpu (the default) for wherever the kernel puts it
+	void set_affinity(const std::vector<int>& cpus);
+	const std::vector<int>& get_affinity();
 protected:
 	pthread_t t;
+
+	// create t running routine(arg), on the cpus of set_affinity
+	int create(void* (*routine)(void*), void* arg);
+private:
+	std::vector<int> affinity;
 };
 
 int Thread::join() {
@@ -25,4 +40,29 @@ int Thread::cancel() {
 	return pthread_cancel(t);
 }
 
+void Thread::set_affinity(const std::vector<int>& cpus) {
+	affinity = cpus;
+}
+
+const std::vector<int>& Thread::get_affinity() {
+	return affinity;
+}
+
+int Thread::create(void* (*routine)(void*), void* arg) {
+	if (affinity.empty())
+		return pthread_create(&t, 0, routine, arg);
+
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	for (int cpu : affinity)
+		CPU_SET(cpu, &cpus);
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+	int error = pthread_create(&t, &attr, routine, arg);
+	pthread_attr_destroy(&attr);
+	return error;
+}
+
 #endif // THREAD_HPP
@@ -0,0 +1,223 @@
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include "thread.hpp"
+
+#ifndef TOPOLOGY_HPP
+#define TOPOLOGY_HPP
+
+#define CPU_TOPOLOGY_ROOT "/sys/devices/system/cpu"
+
+// The CPUs the process may run on, grouped by the last-level cache they
+// share, from the topology the kernel exports under CPU_TOPOLOGY_ROOT.
+struct CpuTopology {
+	// the cache domains, each one CPU of every physical core first,
+	// then the hyperthread siblings of them
+	std::vector<std::vector<int> > domains;
+
+	// read the topology under root, of the CPUs in allowed or, with nullptr,
+	// of the affinity of the process. Without the files every CPU is a core
+	// of its own in one domain.
+	static CpuTopology detect(std::string root = CPU_TOPOLOGY_ROOT, const cpu_set_t* allowed = nullptr);
+
+	// the number of CPUs in all the domains
+	int get_cpus();
+
+	// print a line per domain
+	void print(FILE* out);
+};
+
+enum PlacementPolicy {
+	// the threads run wherever the kernel puts them
+	PLACEMENT_NONE,
+	// the threads of a pipeline are pinned to the CPUs of one cache domain,
+	// the kernel balances them within it
+	PLACEMENT_LLC,
+	// every thread is pinned to CPUs of its own in the domain, as long as
+	// there are CPUs left, then the CPUs are handed out again from the first
+	PLACEMENT_CORE
+};
+
+// Hands out the CPUs of a CpuTopology to the threads of the pipelines.
+// A pipeline claims a cache domain, the pipelines of a sharded run take the
+// domains in turn, and places its threads in it: the reader, the producers it
+// feeds, the consumers fed by them and the writer they feed share the cache
+// the items pass through. Not thread-safe, the pipelines are placed as they start.
+class Placement {
+public:
+	// constructor
+	Placement(PlacementPolicy policy, CpuTopology topology);
+
+	// the cache domain of the next pipeline
+	int claim_domain();
+
+	// pin thread to cpus CPUs of domain, before it starts
+	void place(Thread* thread, int domain, int cpus = 1);
+private:
+	PlacementPolicy policy;
+	CpuTopology topology;
+
+	int next_domain;
+	// the next CPU to hand out in each domain
+	std::vector<size_t> next_cpu;
+};
+
+// the policy of "none", "llc" or "core", false for anything else
+bool parse_placement(std::string name, PlacementPolicy* policy);
+
+// Implementation start
+
+// the first line of a file, empty if it cannot be read
+static std::string read_topology_file(std::string path) {
+	FILE* file = fopen(path.c_str(), "r");
+	if (!file)
+		return "";
+	char line[4096] = "";
+	if (!fgets(line, sizeof(line), file))
+		line[0] = '\0';
+	fclose(file);
+
+	std::string text = line;
+	while (!text.empty() && (text.back() == '\n' || text.back() == ' '))
+		text.pop_back();
+	return text;
+}
+
+// the CPUs of a list like "0-3,8,10-11"
+static std::vector<int> parse_cpu_list(std::string list) {
+	std::vector<int> cpus;
+	const char* p = list.c_str();
+	while (*p) {
+		char* end;
+		int first = strtol(p, &end, 10);
+		if (end == p)
+			break;
+		int last = first;
+		if (*end == '-')
+			last = strtol(end + 1, &end, 10);
+		for (int cpu = first; cpu <= last; cpu++)
+			cpus.push_back(cpu);
+		p = *end == ',' ? end + 1 : end;
+	}
+	return cpus;
+}
+
+CpuTopology CpuTopology::detect(std::string root, const cpu_set_t* allowed) {
+	cpu_set_t affinity;
+	if (!allowed) {
+		CPU_ZERO(&affinity);
+		sched_getaffinity(0, sizeof(affinity), &affinity);
+		allowed = &affinity;
+	}
+
+	std::vector<int> cpus;
+	for (int cpu : parse_cpu_list(read_topology_file(root + "/online")))
+		if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, allowed))
+			cpus.push_back(cpu);
+	if (cpus.empty()) {
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+			if (CPU_ISSET(cpu, allowed))
+				cpus.push_back(cpu);
+	}
+
+	// the domain of a CPU is the lowest CPU sharing its cache of the highest
+	// level, and the rank of a CPU is how many siblings of its core come before it
+	std::map<int, std::vector<std::pair<int, int> > > ranked;
+	std::map<std::pair<std::string, std::string>, int> cores;
+	for (int cpu : cpus) {
+		std::string dir = root + "/cpu" + std::to_string(cpu);
+
+		int domain = 0, level = 0;
+		for (int index = 0; ; index++) {
+			std::string cache = dir + "/cache/index" + std::to_string(index);
+			std::string cache_level = read_topology_file(cache + "/level");
+			if (cache_level.empty())
+				break;
+			std::vector<int> shared = parse_cpu_list(read_topology_file(cache + "/shared_cpu_list"));
+			if (atoi(cache_level.c_str()) > level && !shared.empty()) {
+				level = atoi(cache_level.c_str());
+				domain = *std::min_element(shared.begin(), shared.end());
+			}
+		}
+
+		std::pair<std::string, std::string> core(read_topology_file(dir + "/topology/physical_package_id"),
+			read_topology_file(dir + "/topology/core_id"));
+		int rank = core.second.empty() ? 0 : cores[core]++;
+		ranked[domain].push_back(std::make_pair(rank, cpu));
+	}
+
+	CpuTopology topology;
+	for (auto& domain : ranked) {
+		std::sort(domain.second.begin(), domain.second.end());
+		std::vector<int> ordered;
+		for (std::pair<int, int>& cpu : domain.second)
+			ordered.push_back(cpu.second);
+		topology.domains.push_back(ordered);
+	}
+	return topology;
+}
+
+int CpuTopology::get_cpus() {
+	int cpus = 0;
+	for (std::vector<int>& domain : domains)
+		cpus += domain.size();
+	return cpus;
+}
+
+void CpuTopology::print(FILE* out) {
+	for (size_t i = 0; i < domains.size(); i++) {
+		fprintf(out, "cache domain %zu:", i);
+		for (int cpu : domains[i])
+			fprintf(out, " %d", cpu);
+		fprintf(out, "\n");
+	}
+}
+
+Placement::Placement(PlacementPolicy policy, CpuTopology topology)
+	: policy(policy), topology(topology), next_domain(0), next_cpu(topology.domains.size(), 0) {
+}
+
+int Placement::claim_domain() {
+	if (topology.domains.empty())
+		return 0;
+	int domain = next_domain;
+	next_domain = (next_domain + 1) % topology.domains.size();
+	return domain;
+}
+
+void Placement::place(Thread* thread, int domain, int cpus) {
+	if (policy == PLACEMENT_NONE || topology.domains.empty())
+		return;
+
+	std::vector<int>& domain_cpus = topology.domains[domain];
+	if (policy == PLACEMENT_LLC) {
+		thread->set_affinity(domain_cpus);
+		return;
+	}
+
+	std::vector<int> own;
+	for (int i = 0; i < std::min(cpus, (int)domain_cpus.size()); i++) {
+		own.push_back(domain_cpus[next_cpu[domain]]);
+		next_cpu[domain] = (next_cpu[domain] + 1) % domain_cpus.size();
+	}
+	thread->set_affinity(own);
+}
+
+bool parse_placement(std::string name, PlacementPolicy* policy) {
+	if (name == "none")
+		*policy = PLACEMENT_NONE;
+	else if (name == "llc")
+		*policy = PLACEMENT_LLC;
+	else if (name == "core")
+		*policy = PLACEMENT_CORE;
+	else
+		return false;
+	return true;
+}
+
+#endif // TOPOLOGY_HPP
@@ -0,0 +1,131 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string>
+#include <sys/stat.h>
+#include "topology.hpp"
+
+// a fake topology under root: two caches of two cores of two
+// hyperthreads, cpu i and cpu i + 4 being the siblings of core i
+void write_topology(std::string root) {
+	mkdir(root.c_str(), 0755);
+	FILE* online = fopen((root + "/online").c_str(), "w");
+	fprintf(online, "0-7\n");
+	fclose(online);
+
+	for (int cpu = 0; cpu < 8; cpu++) {
+		std::string dir = root + "/cpu" + std::to_string(cpu);
+		int core = cpu % 4;
+		mkdir(dir.c_str(), 0755);
+		mkdir((dir + "/topology").c_str(), 0755);
+		mkdir((dir + "/cache").c_str(), 0755);
+		mkdir((dir + "/cache/index0").c_str(), 0755);
+		mkdir((dir + "/cache/index1").c_str(), 0755);
+
+		std::string siblings = std::to_string(core) + "," + std::to_string(core + 4);
+		std::string files[][2] = {
+			{"/topology/physical_package_id", "0"},
+			{"/topology/core_id", std::to_string(core)},
+			{"/cache/index0/level", "2"},
+			{"/cache/index0/shared_cpu_list", siblings},
+			{"/cache/index1/level", "3"},
+			{"/cache/index1/shared_cpu_list", core < 2 ? "0-1,4-5" : "2-3,6-7"},
+		};
+		for (auto& file : files) {
+			FILE* f = fopen((dir + file[0]).c_str(), "w");
+			fprintf(f, "%s\n", file[1].c_str());
+			fclose(f);
+		}
+	}
+}
+
+// the CPUs the calling thread may run on
+std::vector<int> current_affinity() {
+	cpu_set_t cpus;
+	pthread_getaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	std::vector<int> affinity;
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		if (CPU_ISSET(cpu, &cpus))
+			affinity.push_back(cpu);
+	return affinity;
+}
+
+class AffinityThread : public Thread {
+public:
+	// the CPUs it ran on
+	std::vector<int> running_on;
+
+	virtual void start() override {
+		create(AffinityThread::process, (void*)this);
+	}
+private:
+	static void* process(void* arg) {
+		((AffinityThread*)arg)->running_on = current_affinity();
+		return nullptr;
+	}
+};
+
+int main() {
+	std::string root = "./tests/topology";
+	write_topology(root);
+
+	cpu_set_t all;
+	CPU_ZERO(&all);
+	for (int cpu = 0; cpu < 8; cpu++)
+		CPU_SET(cpu, &all);
+	CpuTopology topology = CpuTopology::detect(root, &all);
+	topology.print(stdout);
+	assert(topology.domains.size() == 2);
+	assert(topology.domains[0] == std::vector<int>({0, 1, 4, 5}));
+	assert(topology.domains[1] == std::vector<int>({2, 3, 6, 7}));
+
+	// the physical cores first, then the siblings, then around again
+	Placement placement(PLACEMENT_CORE, topology);
+	assert(placement.claim_domain() == 0);
+	assert(placement.claim_domain() == 1);
+	assert(placement.claim_domain() == 0);
+	AffinityThread threads[8];
+	placement.place(&threads[0], 1, 2);
+	placement.place(&threads[1], 1);
+	placement.place(&threads[2], 1);
+	placement.place(&threads[3], 1);
+	assert(threads[0].get_affinity() == std::vector<int>({2, 3}));
+	assert(threads[1].get_affinity() == std::vector<int>({6}));
+	assert(threads[2].get_affinity() == std::vector<int>({7}));
+	assert(threads[3].get_affinity() == std::vector<int>({2}));
+
+	Placement llc(PLACEMENT_LLC, topology);
+	llc.place(&threads[4], 0);
+	assert(threads[4].get_affinity() == topology.domains[0]);
+
+	// only the CPUs of this machine can be set
+	std::vector<int> machine = current_affinity();
+	printf("cpus of the machine:");
+	for (int cpu : machine)
+		printf(" %d", cpu);
+	printf("\n");
+
+	// without the files, the CPUs of the affinity are one domain
+	CpuTopology fallback = CpuTopology::detect("./tests/no_topology");
+	assert(fallback.domains.size() == 1 && fallback.domains[0] == machine);
+
+	// pinned to the first CPU of the machine, and left alone
+	Placement core(PLACEMENT_CORE, fallback);
+	core.place(&threads[5], core.claim_domain());
+	Placement none(PLACEMENT_NONE, fallback);
+	none.place(&threads[6], none.claim_domain());
+	for (int i = 5; i < 7; i++) {
+		threads[i].start();
+		threads[i].join();
+	}
+	assert(threads[5].running_on == std::vector<int>({machine[0]}));
+	assert(threads[6].running_on == machine);
+
+	// the policy names of --placement, and nothing else
+	PlacementPolicy policy;
+	assert(parse_placement("none", &policy) && policy == PLACEMENT_NONE);
+	assert(parse_placement("llc", &policy) && policy == PLACEMENT_LLC);
+	assert(parse_placement("core", &policy) && policy == PLACEMENT_CORE);
+	assert(!parse_placement("socket", &policy) && !parse_placement("", &policy));
+
+	return 0;
+}
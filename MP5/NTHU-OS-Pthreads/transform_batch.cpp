@@ -0,0 +1,230 @@
+#include <assert.h>
+#include <string.h>
+#include <immintrin.h>
+#include <vector>
+#include "transformer.hpp"
+
+// The batch kernels apply x -> (a * x + b) % m a number of times to values
+// that are already reduced modulo m. They multiply with Montgomery's REDC
+// for R = 2^32: with mont_a = a * R mod m,
+//   REDC(x * mont_a) = x * mont_a * R^-1 = x * a (mod m),
+// so the values never leave the normal domain, and every product is one of
+// the 32 x 32 -> 64-bit multiplies AVX2 and AVX-512 offer per 64-bit lane.
+// This needs an odd m below 2^30, other specs take the plain % path.
+
+struct BatchParams {
+	// the multiplier in Montgomery form, a * 2^32 mod m
+	unsigned long long mont_a;
+	unsigned long long b;
+	unsigned long long m;
+	// -m^-1 mod 2^32
+	unsigned long long m_inv;
+	int steps;
+};
+
+typedef void (*BatchKernel)(unsigned long long* vals, int n, const BatchParams& p);
+
+static inline unsigned long long redc_step(unsigned long long x, const BatchParams& p) {
+	unsigned long long t = x * p.mont_a;
+	unsigned long long q = (t * p.m_inv) & 0xffffffffULL;
+	// t + q * m is divisible by 2^32, and the quotient is below 2m
+	t = (t + q * p.m) >> 32;
+	t = t >= p.m ? t - p.m : t;
+	t += p.b;
+	return t >= p.m ? t - p.m : t;
+}
+
+static void batch_scalar(unsigned long long* vals, int n, const BatchParams& p) {
+	int i = 0;
+
+	// four independent chains per loop, so that their multiplies overlap
+	for (; i + 4 <= n; i += 4) {
+		unsigned long long x0 = vals[i], x1 = vals[i + 1], x2 = vals[i + 2], x3 = vals[i + 3];
+		for (int s = 0; s < p.steps; s++) {
+			x0 = redc_step(x0, p);
+			x1 = redc_step(x1, p);
+			x2 = redc_step(x2, p);
+			x3 = redc_step(x3, p);
+		}
+		vals[i] = x0;
+		vals[i + 1] = x1;
+		vals[i + 2] = x2;
+		vals[i + 3] = x3;
+	}
+
+	for (; i < n; i++) {
+		unsigned long long x = vals[i];
+		for (int s = 0; s < p.steps; s++)
+			x = redc_step(x, p);
+		vals[i] = x;
+	}
+}
+
+// The vector steps keep every value below 2^32, so the conditional
+// subtractions are min(t, t - m) on unsigned 32-bit halves: t - m wraps
+// around to a large value exactly when t < m, and the upper halves stay 0.
+
+__attribute__((target("avx2")))
+static inline __m256i redc_step_avx2(__m256i x, __m256i mont_a, __m256i b, __m256i m, __m256i m_inv) {
+	__m256i t = _mm256_mul_epu32(x, mont_a);
+	__m256i q = _mm256_mul_epu32(t, m_inv);
+	t = _mm256_srli_epi64(_mm256_add_epi64(t, _mm256_mul_epu32(q, m)), 32);
+	t = _mm256_min_epu32(t, _mm256_sub_epi32(t, m));
+	t = _mm256_add_epi64(t, b);
+	return _mm256_min_epu32(t, _mm256_sub_epi32(t, m));
+}
+
+__attribute__((target("avx2")))
+static void batch_avx2(unsigned long long* vals, int n, const BatchParams& p) {
+	__m256i mont_a = _mm256_set1_epi64x(p.mont_a);
+	__m256i b = _mm256_set1_epi64x(p.b);
+	__m256i m = _mm256_set1_epi64x(p.m);
+	__m256i m_inv = _mm256_set1_epi64x(p.m_inv);
+	int i = 0;
+
+	// two vectors of four lanes per loop, to hide the multiply latency
+	for (; i + 8 <= n; i += 8) {
+		__m256i x0 = _mm256_loadu_si256((__m256i*)(vals + i));
+		__m256i x1 = _mm256_loadu_si256((__m256i*)(vals + i + 4));
+		for (int s = 0; s < p.steps; s++) {
+			x0 = redc_step_avx2(x0, mont_a, b, m, m_inv);
+			x1 = redc_step_avx2(x1, mont_a, b, m, m_inv);
+		}
+		_mm256_storeu_si256((__m256i*)(vals + i), x0);
+		_mm256_storeu_si256((__m256i*)(vals + i + 4), x1);
+	}
+
+	for (; i + 4 <= n; i += 4) {
+		__m256i x = _mm256_loadu_si256((__m256i*)(vals + i));
+		for (int s = 0; s < p.steps; s++)
+			x = redc_step_avx2(x, mont_a, b, m, m_inv);
+		_mm256_storeu_si256((__m256i*)(vals + i), x);
+	}
+
+	batch_scalar(vals + i, n - i, p);
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i redc_step_avx512(__m512i x, __m512i mont_a, __m512i b, __m512i m, __m512i m_inv) {
+	__m512i t = _mm512_mul_epu32(x, mont_a);
+	__m512i q = _mm512_mul_epu32(t, m_inv);
+	t = _mm512_srli_epi64(_mm512_add_epi64(t, _mm512_mul_epu32(q, m)), 32);
+	t = _mm512_min_epu32(t, _mm512_sub_epi32(t, m));
+	t = _mm512_add_epi64(t, b);
+	return _mm512_min_epu32(t, _mm512_sub_epi32(t, m));
+}
+
+__attribute__((target("avx512f")))
+static void batch_avx512(unsigned long long* vals, int n, const BatchParams& p) {
+	__m512i mont_a = _mm512_set1_epi64(p.mont_a);
+	__m512i b = _mm512_set1_epi64(p.b);
+	__m512i m = _mm512_set1_epi64(p.m);
+	__m512i m_inv = _mm512_set1_epi64(p.m_inv);
+	int i = 0;
+
+	// two vectors of eight lanes per loop, to hide the multiply latency
+	for (; i + 16 <= n; i += 16) {
+		__m512i x0 = _mm512_loadu_si512(vals + i);
+		__m512i x1 = _mm512_loadu_si512(vals + i + 8);
+		for (int s = 0; s < p.steps; s++) {
+			x0 = redc_step_avx512(x0, mont_a, b, m, m_inv);
+			x1 = redc_step_avx512(x1, mont_a, b, m, m_inv);
+		}
+		_mm512_storeu_si512(vals + i, x0);
+		_mm512_storeu_si512(vals + i + 8, x1);
+	}
+
+	for (; i + 8 <= n; i += 8) {
+		__m512i x = _mm512_loadu_si512(vals + i);
+		for (int s = 0; s < p.steps; s++)
+			x = redc_step_avx512(x, mont_a, b, m, m_inv);
+		_mm512_storeu_si512(vals + i, x);
+	}
+
+	batch_avx2(vals + i, n - i, p);
+}
+
+// the best kernel the CPU supports, picked once at startup
+static BatchKernel select_batch_kernel() {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return batch_avx512;
+	if (__builtin_cpu_supports("avx2"))
+		return batch_avx2;
+	return batch_scalar;
+}
+
+static BatchKernel batch_kernel = select_batch_kernel();
+
+bool Transformer::set_batch_isa(const char* isa) {
+	__builtin_cpu_init();
+	if (strcmp(isa, "auto") == 0) {
+		batch_kernel = select_batch_kernel();
+	} else if (strcmp(isa, "scalar") == 0) {
+		batch_kernel = batch_scalar;
+	} else if (strcmp(isa, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+		batch_kernel = batch_avx2;
+	} else if (strcmp(isa, "avx512") == 0 && __builtin_cpu_supports("avx512f")) {
+		batch_kernel = batch_avx512;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+// apply spec to every value, with the jump-ahead map or iteratively
+static void apply_batch(const TransformSpec* spec, unsigned long long* vals, int n, bool jump) {
+	// the first step as is, the values may not be reduced modulo m yet
+	for (int i = 0; i < n; i++)
+		vals[i] = (vals[i] * spec->a + spec->b) % spec->m;
+
+	unsigned long long a = jump ? spec->jump.a : spec->a % spec->m;
+	unsigned long long b = jump ? spec->jump.b : spec->b % spec->m;
+	int steps = jump ? 1 : spec->iterations - 1;
+
+	if (spec->m % 2 == 0 || spec->m >= (1ULL << 30)) {
+		for (int i = 0; i < n; i++) {
+			for (int s = 0; s < steps; s++)
+				vals[i] = (vals[i] * a + b) % spec->m;
+		}
+		return;
+	}
+
+	BatchParams params = {jump ? spec->mont_jump_a : spec->mont_a, b, spec->m, spec->mont_m_inv, steps};
+	batch_kernel(vals, n, params);
+}
+
+void Transformer::transform_batch(const TransformSpec* spec, unsigned long long* vals, int n) {
+	if (spec->iterations <= 0)
+		return;
+
+	if (mode == TRANSFORM_VERIFY) {
+		std::vector<unsigned long long> expected(n), jumped(vals, vals + n);
+		for (int i = 0; i < n; i++)
+			expected[i] = iterate(spec, vals[i]);
+
+		apply_batch(spec, jumped.data(), n, true);
+		apply_batch(spec, vals, n, false);
+		for (int i = 0; i < n; i++)
+			assert(vals[i] == expected[i] && jumped[i] == expected[i]);
+		return;
+	}
+
+	apply_batch(spec, vals, n, mode == TRANSFORM_JUMP_AHEAD);
+}
+
+// Without SIMD the iterative loop runs the TransformKernel of the opcode,
+// its Barrett reduction by a constant needing no Montgomery form.
+void Transformer::producer_transform_batch(char opcode, unsigned long long* vals, int n) {
+	if (mode == TRANSFORM_ITERATIVE && batch_kernel == batch_scalar)
+		producer_iterate_batch(opcode, vals, n);
+	else
+		transform_batch(producer_spec(opcode), vals, n);
+}
+
+void Transformer::consumer_transform_batch(char opcode, unsigned long long* vals, int n) {
+	if (mode == TRANSFORM_ITERATIVE && batch_kernel == batch_scalar)
+		consumer_iterate_batch(opcode, vals, n);
+	else
+		transform_batch(consumer_spec(opcode), vals, n);
+}
@@ -0,0 +1,213 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <vector>
+#include "stats.hpp"
+#include "transformer.hpp"
+
+#ifndef TRANSFORM_CACHE_HPP
+#define TRANSFORM_CACHE_HPP
+
+// the number of shards, each under its own lock
+#define TRANSFORM_CACHE_SHARDS 64
+// the slots a key may take, from its home slot on
+#define TRANSFORM_CACHE_WAYS 8
+
+// the stage of a transform, a part of the cache key
+enum TransformStage {
+	TRANSFORM_PRODUCER,
+	TRANSFORM_CONSUMER
+};
+
+// A bounded memo of the transform results, keyed by (stage, opcode, input
+// value) and shared by every producer and consumer, for inputs that repeat
+// values: a hit costs a hash probe instead of the millions of iterations of
+// an iterative transform.
+//
+// The keys are spread by hash over TRANSFORM_CACHE_SHARDS shards, each an
+// open-addressing table of a power of two slots under its own mutex. A key
+// lives in one of the TRANSFORM_CACHE_WAYS slots from its home slot, so a
+// lookup probes at most that many; an insert into a full window evicts with
+// the CLOCK policy: a hit marks its slot referenced, and the insert takes the
+// first unreferenced slot of the window, clearing the marks on its way, or
+// the home slot when every slot was referenced.
+class TransformCache {
+public:
+	// the buffers of one thread for transform
+	class Misses {
+	public:
+		Misses() {}
+	private:
+		friend class TransformCache;
+		// the values missed and their positions in the batch
+		std::vector<unsigned long long> vals;
+		std::vector<int> positions;
+	};
+
+	// constructor, capacity is the number of entries, rounded up
+	// to a power of two slots per shard
+	explicit TransformCache(int capacity);
+
+	// destructor
+	~TransformCache();
+
+	// transform the n values of opcode in place with transform_batch
+	// (the Transformer batch call of stage), only computing the values that
+	// are not cached and caching them
+	void transform(TransformStage stage, char opcode, unsigned long long* vals, int n,
+		Transformer* transformer, void (Transformer::*transform_batch)(char, unsigned long long*, int),
+		Misses* misses);
+
+	// the hits, misses and evictions so far
+	CacheStats& get_stats();
+
+	// print the counters and the memory of the slots
+	void print_summary(FILE* out);
+private:
+	struct Slot {
+		unsigned long long val;
+		unsigned long long result;
+		// (stage << 8 | opcode) + 1, 0 for a free slot
+		unsigned short tag;
+		bool referenced;
+	};
+
+	struct Shard {
+		pthread_mutex_t mutex;
+		Slot* slots;
+	};
+
+	Shard shards[TRANSFORM_CACHE_SHARDS];
+	// the slots of a shard, minus one
+	unsigned mask;
+
+	CacheStats stats;
+
+	static unsigned short make_tag(TransformStage stage, char opcode);
+
+	static unsigned long long hash(unsigned short tag, unsigned long long val);
+
+	// the cached result of (tag, val), false if it is not cached
+	bool lookup(unsigned short tag, unsigned long long val, unsigned long long* result);
+
+	void insert(unsigned short tag, unsigned long long val, unsigned long long result);
+};
+
+// Implementation start
+
+TransformCache::TransformCache(int capacity) : mask(0) {
+	unsigned per_shard = TRANSFORM_CACHE_WAYS;
+	while (per_shard * TRANSFORM_CACHE_SHARDS < (unsigned)capacity)
+		per_shard *= 2;
+	mask = per_shard - 1;
+
+	for (Shard& shard : shards) {
+		pthread_mutex_init(&shard.mutex, nullptr);
+		shard.slots = new Slot[per_shard]();
+	}
+}
+
+TransformCache::~TransformCache() {
+	for (Shard& shard : shards) {
+		pthread_mutex_destroy(&shard.mutex);
+		delete[] shard.slots;
+	}
+}
+
+unsigned short TransformCache::make_tag(TransformStage stage, char opcode) {
+	return (stage << 8 | (unsigned char)opcode) + 1;
+}
+
+unsigned long long TransformCache::hash(unsigned short tag, unsigned long long val) {
+	// a multiplicative hash, then the high bits folded into the low ones
+	unsigned long long h = (val ^ (unsigned long long)tag << 48) * 0x9e3779b97f4a7c15ULL;
+	return h ^ h >> 29;
+}
+
+bool TransformCache::lookup(unsigned short tag, unsigned long long val, unsigned long long* result) {
+	unsigned long long h = hash(tag, val);
+	Shard& shard = shards[h % TRANSFORM_CACHE_SHARDS];
+	unsigned home = (h / TRANSFORM_CACHE_SHARDS) & mask;
+
+	pthread_mutex_lock(&shard.mutex);
+	for (int way = 0; way < TRANSFORM_CACHE_WAYS; way++) {
+		Slot& slot = shard.slots[(home + way) & mask];
+		if (slot.tag == tag && slot.val == val) {
+			slot.referenced = true;
+			*result = slot.result;
+			pthread_mutex_unlock(&shard.mutex);
+			return true;
+		}
+	}
+	pthread_mutex_unlock(&shard.mutex);
+	return false;
+}
+
+void TransformCache::insert(unsigned short tag, unsigned long long val, unsigned long long result) {
+	unsigned long long h = hash(tag, val);
+	Shard& shard = shards[h % TRANSFORM_CACHE_SHARDS];
+	unsigned home = (h / TRANSFORM_CACHE_SHARDS) & mask;
+
+	pthread_mutex_lock(&shard.mutex);
+	Slot* victim = nullptr;
+	for (int way = 0; way < TRANSFORM_CACHE_WAYS && !victim; way++) {
+		Slot& slot = shard.slots[(home + way) & mask];
+		// another thread may have computed the same key meanwhile
+		if (!slot.tag || (slot.tag == tag && slot.val == val))
+			victim = &slot;
+	}
+	for (int way = 0; way < TRANSFORM_CACHE_WAYS && !victim; way++) {
+		Slot& slot = shard.slots[(home + way) & mask];
+		if (!slot.referenced)
+			victim = &slot;
+		slot.referenced = false;
+	}
+	if (!victim)
+		victim = &shard.slots[home];
+
+	if (victim->tag && !(victim->tag == tag && victim->val == val))
+		stats.evictions.fetch_add(1, std::memory_order_relaxed);
+	*victim = Slot{val, result, tag, false};
+	pthread_mutex_unlock(&shard.mutex);
+}
+
+void TransformCache::transform(TransformStage stage, char opcode, unsigned long long* vals, int n,
+	Transformer* transformer, void (Transformer::*transform_batch)(char, unsigned long long*, int),
+	Misses* misses) {
+	unsigned short tag = make_tag(stage, opcode);
+
+	misses->vals.clear();
+	misses->positions.clear();
+	for (int i = 0; i < n; i++) {
+		if (!lookup(tag, vals[i], &vals[i])) {
+			misses->vals.push_back(vals[i]);
+			misses->positions.push_back(i);
+		}
+	}
+
+	int missed = misses->vals.size();
+	stats.record(n - missed, missed);
+	if (missed == 0)
+		return;
+
+	(transformer->*transform_batch)(opcode, misses->vals.data(), missed);
+	for (int i = 0; i < missed; i++) {
+		int position = misses->positions[i];
+		insert(tag, vals[position], misses->vals[i]);
+		vals[position] = misses->vals[i];
+	}
+}
+
+CacheStats& TransformCache::get_stats() {
+	return stats;
+}
+
+void TransformCache::print_summary(FILE* out) {
+	long long hits = stats.hits.load(std::memory_order_relaxed);
+	long long misses = stats.misses.load(std::memory_order_relaxed);
+	fprintf(out, "transform cache: %lld hits, %lld misses (%.1f%% hit rate), %lld evictions, %zu bytes of slots\n",
+		hits, misses, hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0,
+		stats.evictions.load(std::memory_order_relaxed),
+		(size_t)(mask + 1) * TRANSFORM_CACHE_SHARDS * sizeof(Slot));
+}
+
+#endif // TRANSFORM_CACHE_HPP
@@ -0,0 +1,32 @@
+#include <assert.h>
+#include <stdio.h>
+#include "transform_cache.hpp"
+
+int main() {
+	Transformer* transformer = new Transformer;
+	// the smallest cache, so the repeats below also evict
+	TransformCache* cache = new TransformCache(1);
+	TransformCache::Misses misses;
+
+	const char* opcodes = "ABCDE";
+	for (int round = 0; round < 3; round++) {
+		for (int o = 0; o < 5; o++) {
+			unsigned long long vals[64], expected[64];
+			for (int i = 0; i < 64; i++)
+				vals[i] = expected[i] = (i * 7 + round) % 100;
+
+			cache->transform(TRANSFORM_CONSUMER, opcodes[o], vals, 64, transformer,
+				&Transformer::consumer_transform_batch, &misses);
+			transformer->consumer_transform_batch(opcodes[o], expected, 64);
+			for (int i = 0; i < 64; i++)
+				assert(vals[i] == expected[i]);
+		}
+	}
+
+	cache->print_summary(stdout);
+
+	delete cache;
+	delete transformer;
+
+	return 0;
+}
@@ -3,110 +3,223 @@
 #include <assert.h>
 #include "transformer.hpp"
 
-unsigned long long Transformer::producer_transform(char opcode, unsigned long long val) {
-	TransformSpec* spec = new TransformSpec;
+// the jump-ahead maps are folded at compile time
+static constexpr TransformSpec producer_specs[] = {
+	// A: same speed
+	make_transform_spec(2003, 183492, 1000000007, 9000000),
+	// B: consumer faster than producer
+	make_transform_spec(2143, 191324, 1000000009, 12000000),
+	// C: producer faster than consumer
+	make_transform_spec(2089, 923134, 1000000021, 5000000),
+	// D: producer slightly faster than consumer
+	make_transform_spec(2677, 912834, 1000000033, 7000000),
+	// E: consumer slightly faster than producer
+	make_transform_spec(2693, 718341, 1000000087, 12000000),
+};
+
+static constexpr TransformSpec consumer_specs[] = {
+	// A: same speed
+	make_transform_spec(2729, 713423, 1000000093, 9000000),
+	// B: consumer faster than producer
+	make_transform_spec(2617, 193424, 1000000097, 5000000),
+	// C: producer faster than consumer
+	make_transform_spec(2053, 743142, 1000000103, 12000000),
+	// D: producer slightly faster than consumer
+	make_transform_spec(2347, 617345, 1000000123, 12000000),
+	// E: consumer slightly faster than producer
+	make_transform_spec(2521, 4719832, 1000000181, 7000000),
+};
+
+const TransformSpec* Transformer::producer_spec(char opcode) {
+	switch (opcode) {
+	case 'A':
+		return &producer_specs[0];
+
+	case 'B':
+		return &producer_specs[1];
+
+	case 'C':
+		return &producer_specs[2];
+
+	case 'D':
+		return &producer_specs[3];
+
+	case 'E':
+		return &producer_specs[4];
+
+	default:
+		assert(false);
+		return nullptr;
+	}
+}
+
+const TransformSpec* Transformer::consumer_spec(char opcode) {
+	switch (opcode) {
+	case 'A':
+		return &consumer_specs[0];
+
+	case 'B':
+		return &consumer_specs[1];
 
+	case 'C':
+		return &consumer_specs[2];
+
+	case 'D':
+		return &consumer_specs[3];
+
+	case 'E':
+		return &consumer_specs[4];
+
+	default:
+		assert(false);
+		return nullptr;
+	}
+}
+
+unsigned long long Transformer::producer_iterate(char opcode, unsigned long long val) {
 	switch (opcode) {
-	// same speed
 	case 'A':
-		spec->a = 2003;
-		spec->b = 183492;
-		spec->m = 1000000007;
-		spec->iterations = 9000000;
+		return TransformKernel<2003, 183492, 1000000007, 9000000>::iterate(val);
+
+	case 'B':
+		return TransformKernel<2143, 191324, 1000000009, 12000000>::iterate(val);
+
+	case 'C':
+		return TransformKernel<2089, 923134, 1000000021, 5000000>::iterate(val);
+
+	case 'D':
+		return TransformKernel<2677, 912834, 1000000033, 7000000>::iterate(val);
+
+	case 'E':
+		return TransformKernel<2693, 718341, 1000000087, 12000000>::iterate(val);
+
+	default:
+		assert(false);
+		return val;
+	}
+}
+
+unsigned long long Transformer::consumer_iterate(char opcode, unsigned long long val) {
+	switch (opcode) {
+	case 'A':
+		return TransformKernel<2729, 713423, 1000000093, 9000000>::iterate(val);
+
+	case 'B':
+		return TransformKernel<2617, 193424, 1000000097, 5000000>::iterate(val);
+
+	case 'C':
+		return TransformKernel<2053, 743142, 1000000103, 12000000>::iterate(val);
+
+	case 'D':
+		return TransformKernel<2347, 617345, 1000000123, 12000000>::iterate(val);
+
+	case 'E':
+		return TransformKernel<2521, 4719832, 1000000181, 7000000>::iterate(val);
+
+	default:
+		assert(false);
+		return val;
+	}
+}
+
+void Transformer::producer_iterate_batch(char opcode, unsigned long long* vals, int n) {
+	switch (opcode) {
+	case 'A':
+		TransformKernel<2003, 183492, 1000000007, 9000000>::iterate_batch(vals, n);
 		break;
 
-	// consumer faster than producer
 	case 'B':
-		spec->a = 2143;
-		spec->b = 191324;
-		spec->m = 1000000009;
-		spec->iterations = 12000000;
+		TransformKernel<2143, 191324, 1000000009, 12000000>::iterate_batch(vals, n);
 		break;
 
-	// producer faster than consumer
 	case 'C':
-		spec->a = 2089;
-		spec->b = 923134;
-		spec->m = 1000000021;
-		spec->iterations = 5000000;
+		TransformKernel<2089, 923134, 1000000021, 5000000>::iterate_batch(vals, n);
 		break;
 
-	// producer slightly faster than consumer
 	case 'D':
-		spec->a = 2677;
-		spec->b = 912834;
-		spec->m = 1000000033;
-		spec->iterations = 7000000;
+		TransformKernel<2677, 912834, 1000000033, 7000000>::iterate_batch(vals, n);
 		break;
 
-	// consumer slightly faster than producer
 	case 'E':
-		spec->a = 2693;
-		spec->b = 718341;
-		spec->m = 1000000087;
-		spec->iterations = 12000000;
+		TransformKernel<2693, 718341, 1000000087, 12000000>::iterate_batch(vals, n);
 		break;
 
 	default:
 		assert(false);
 	}
-
-	return transform(spec, val);
 }
 
-unsigned long long Transformer::consumer_transform(char opcode, unsigned long long val) {
-	TransformSpec* spec = new TransformSpec;
-
+void Transformer::consumer_iterate_batch(char opcode, unsigned long long* vals, int n) {
 	switch (opcode) {
-	// same speed
 	case 'A':
-		spec->a = 2729;
-		spec->b = 713423;
-		spec->m = 1000000093;
-		spec->iterations = 9000000;
+		TransformKernel<2729, 713423, 1000000093, 9000000>::iterate_batch(vals, n);
 		break;
 
-	// consumer faster than producer
 	case 'B':
-		spec->a = 2617;
-		spec->b = 193424;
-		spec->m = 1000000097;
-		spec->iterations = 5000000;
+		TransformKernel<2617, 193424, 1000000097, 5000000>::iterate_batch(vals, n);
 		break;
 
-	// producer faster than consumer
 	case 'C':
-		spec->a = 2053;
-		spec->b = 743142;
-		spec->m = 1000000103;
-		spec->iterations = 12000000;
+		TransformKernel<2053, 743142, 1000000103, 12000000>::iterate_batch(vals, n);
 		break;
 
-	// producer slightly faster than consumer
 	case 'D':
-		spec->a = 2347;
-		spec->b = 617345;
-		spec->m = 1000000123;
-		spec->iterations = 12000000;
+		TransformKernel<2347, 617345, 1000000123, 12000000>::iterate_batch(vals, n);
 		break;
 
-	// consumer slightly faster than producer
 	case 'E':
-		spec->a = 2521;
-		spec->b = 4719832;
-		spec->m = 1000000181;
-		spec->iterations = 7000000;
+		TransformKernel<2521, 4719832, 1000000181, 7000000>::iterate_batch(vals, n);
 		break;
 
 	default:
 		assert(false);
 	}
+}
+
+unsigned long long Transformer::producer_transform(char opcode, unsigned long long val) {
+	switch (mode) {
+	case TRANSFORM_ITERATIVE:
+		return producer_iterate(opcode, val);
+
+	case TRANSFORM_VERIFY: {
+		unsigned long long expected = iterate(producer_spec(opcode), val);
+		assert(producer_iterate(opcode, val) == expected);
+		assert(jump(producer_spec(opcode), val) == expected);
+		return expected;
+	}
+
+	default:
+		return jump(producer_spec(opcode), val);
+	}
+}
+
+unsigned long long Transformer::consumer_transform(char opcode, unsigned long long val) {
+	switch (mode) {
+	case TRANSFORM_ITERATIVE:
+		return consumer_iterate(opcode, val);
+
+	case TRANSFORM_VERIFY: {
+		unsigned long long expected = iterate(consumer_spec(opcode), val);
+		assert(consumer_iterate(opcode, val) == expected);
+		assert(jump(consumer_spec(opcode), val) == expected);
+		return expected;
+	}
+
+	default:
+		return jump(consumer_spec(opcode), val);
+	}
+}
+
+unsigned long long Transformer::jump(const TransformSpec* spec, unsigned long long val) {
+	if (spec->iterations <= 0)
+		return val;
 
-	return transform(spec, val);
+	val = (val * spec->a + spec->b) % spec->m;
+	return (val * spec->jump.a + spec->jump.b) % spec->m;
 }
 
-unsigned long long Transformer::transform(TransformSpec* spec, unsigned long long val) {
-	while (spec->iterations--) {
+unsigned long long Transformer::iterate(const TransformSpec* spec, unsigned long long val) {
+	for (int i = 0; i < spec->iterations; i++) {
 		val = (val * spec->a + spec->b) % spec->m;
 	}
   return val;
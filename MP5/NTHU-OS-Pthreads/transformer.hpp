@@ -2,16 +2,127 @@
 #ifndef TRANSFORMER_HPP
 #define TRANSFORMER_HPP
 
+// the affine map x -> (a * x + b) % m
+struct AffineMap {
+  unsigned long long a;
+  unsigned long long b;
+};
+
 struct TransformSpec {
   unsigned long long a;
   unsigned long long b;
   unsigned long long m;
   int iterations;
+  // the last iterations - 1 steps composed into one affine map,
+  // see make_transform_spec
+  AffineMap jump;
+  // -m^-1 mod 2^32 and the multipliers a and jump.a times 2^32 mod m,
+  // for the Montgomery multiplications of the batch kernels
+  unsigned long long mont_m_inv;
+  unsigned long long mont_a;
+  unsigned long long mont_jump_a;
+};
+
+// f after g, all coefficients are already reduced modulo m (< 2^32),
+// so the products cannot overflow
+constexpr AffineMap affine_compose(AffineMap f, AffineMap g, unsigned long long m) {
+  return AffineMap{f.a * g.a % m, (f.a * g.b + f.b) % m};
+}
+
+// f applied n times, by repeated squaring
+constexpr AffineMap affine_power(AffineMap f, int n, unsigned long long m) {
+  return n == 0 ? AffineMap{1, 0}
+       : n % 2 ? affine_compose(f, affine_power(f, n - 1, m), m)
+       : affine_power(affine_compose(f, f, m), n / 2, m);
+}
+
+// m^-1 mod 2^32 for an odd m by Newton's iteration,
+// starting from x = m (3 correct bits) and doubling the correct bits each step
+constexpr unsigned long long montgomery_inverse(unsigned long long m, unsigned long long x, int steps) {
+  return steps == 0 ? x : montgomery_inverse(m, x * (2 - m * x) & 0xffffffffULL, steps - 1);
+}
+
+constexpr TransformSpec make_transform_spec_with_jump(unsigned long long a, unsigned long long b,
+                                                      unsigned long long m, int iterations,
+                                                      AffineMap jump) {
+  return TransformSpec{a, b, m, iterations, jump,
+                       (0x100000000ULL - montgomery_inverse(m, m, 4)) & 0xffffffffULL,
+                       ((a % m) << 32) % m,
+                       (jump.a << 32) % m};
+}
+
+// n applications of x -> (a * x + b) % m are themselves one affine map
+// (A, B) = (a^n, b * (a^n - 1) / (a - 1)) mod m.
+// The first step is kept apart because the input value is not reduced
+// modulo m yet, and x * a may wrap around like in the iterative loop.
+constexpr TransformSpec make_transform_spec(unsigned long long a, unsigned long long b,
+                                            unsigned long long m, int iterations) {
+  return make_transform_spec_with_jump(a, b, m, iterations,
+      affine_power(AffineMap{a % m, b % m}, iterations > 1 ? iterations - 1 : 0, m));
+}
+
+// x % M without a division: Barrett reduction with mu = floor(2^64 / M).
+// The estimated quotient is at most one below the real one for any 64-bit x,
+// so one conditional subtraction gives the exact remainder, also for the
+// wrapped-around val * a of the first step.
+template <unsigned long long M>
+struct Barrett {
+  static constexpr unsigned long long mu = ~0ULL / M;
+
+  static inline unsigned long long reduce(unsigned long long x) {
+    unsigned long long q = (unsigned long long)(((unsigned __int128)x * mu) >> 64);
+    unsigned long long r = x - q * M;
+    return r >= M ? r - M : r;
+  }
+};
+
+// The iterative transform of one opcode, with every coefficient known at
+// compile time so the hot loop is a multiply-add and a Barrett reduction.
+// auto_gen_transformer.py instantiates one kernel per opcode and stage.
+template <unsigned long long A, unsigned long long B, unsigned long long M, int ITERATIONS>
+struct TransformKernel {
+  static unsigned long long iterate(unsigned long long val) {
+    for (int i = 0; i < ITERATIONS; i++) {
+      val = Barrett<M>::reduce(val * A + B);
+    }
+    return val;
+  }
+
+  // iterate every value, four independent chains at a time so that their
+  // multiplies overlap
+  static void iterate_batch(unsigned long long* vals, int n) {
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+      unsigned long long x0 = vals[i], x1 = vals[i + 1], x2 = vals[i + 2], x3 = vals[i + 3];
+      for (int s = 0; s < ITERATIONS; s++) {
+        x0 = Barrett<M>::reduce(x0 * A + B);
+        x1 = Barrett<M>::reduce(x1 * A + B);
+        x2 = Barrett<M>::reduce(x2 * A + B);
+        x3 = Barrett<M>::reduce(x3 * A + B);
+      }
+      vals[i] = x0;
+      vals[i + 1] = x1;
+      vals[i + 2] = x2;
+      vals[i + 3] = x3;
+    }
+    for (; i < n; i++)
+      vals[i] = iterate(vals[i]);
+  }
+};
+
+enum TransformMode {
+  // O(1) per item with the precomputed jump-ahead map
+  TRANSFORM_JUMP_AHEAD,
+  // the iterative loop, with the per-opcode TransformKernel on the scalar
+  // batch ISA and the Montgomery batch kernels on AVX2 and AVX-512
+  TRANSFORM_ITERATIVE,
+  // both, asserting that they agree bit for bit
+  TRANSFORM_VERIFY
 };
 
 class Transformer {
 public:
-  Transformer() {};
+  explicit Transformer(TransformMode mode = TRANSFORM_JUMP_AHEAD) : mode(mode) {};
   ~Transformer() {};
 
   // the producer's work
@@ -20,8 +131,35 @@ public:
   // the consumer's work
   unsigned long long consumer_transform(char opcode, unsigned long long val);
 
+  // the producer's and the consumer's work on n values sharing one opcode,
+  // several values at a time in SIMD lanes (see transform_batch.cpp)
+  void producer_transform_batch(char opcode, unsigned long long* vals, int n);
+  void consumer_transform_batch(char opcode, unsigned long long* vals, int n);
+
+  // pick the batch kernel: "scalar", "avx2", "avx512" or "auto" (the default,
+  // the best one the CPU supports), returns false if the CPU lacks it
+  static bool set_batch_isa(const char* isa);
+
+  // the specs of each opcode
+  static const TransformSpec* producer_spec(char opcode);
+  static const TransformSpec* consumer_spec(char opcode);
+
+  // apply spec with the precomputed jump-ahead map
+  static unsigned long long jump(const TransformSpec* spec, unsigned long long val);
+
+  // apply spec one iteration at a time, the reference implementation
+  static unsigned long long iterate(const TransformSpec* spec, unsigned long long val);
+
+  // apply the spec of opcode one iteration at a time, with its TransformKernel
+  static unsigned long long producer_iterate(char opcode, unsigned long long val);
+  static unsigned long long consumer_iterate(char opcode, unsigned long long val);
+  static void producer_iterate_batch(char opcode, unsigned long long* vals, int n);
+  static void consumer_iterate_batch(char opcode, unsigned long long* vals, int n);
+
 private:
-  unsigned long long transform(TransformSpec* spec, unsigned long long val);
+  TransformMode mode;
+
+  void transform_batch(const TransformSpec* spec, unsigned long long* vals, int n);
 };
 
 #endif // TRANSFORMER_HPP
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <vector>
+#include "item.hpp"
+#include "transformer.hpp"
+
+// Checks that the jump-ahead transform, the per-opcode iterative kernels
+// and every batch kernel agree bit for bit with the reference iterative
+// loop on the first lines of every given input file.
+// usage: ./transformer_test [lines] [input files...]
+int main(int argc, char** argv) {
+	int lines = argc > 1 ? atoi(argv[1]) : 8;
+
+	const char* default_inputs[] = {"./tests/00.in", "./tests/01.in"};
+	const char** inputs = argc > 2 ? (const char**)argv + 2 : default_inputs;
+	int num_inputs = argc > 2 ? argc - 2 : 2;
+
+	std::vector<Item> items;
+	for (int i = 0; i < num_inputs; i++) {
+		std::ifstream ifs(inputs[i]);
+		Item item;
+		for (int j = 0; j < lines && ifs >> item; j++)
+			items.push_back(item);
+	}
+
+	int checked = 0, failed = 0;
+	int n = items.size();
+	// the expected values after the producer stage and after the consumer stage
+	std::vector<unsigned long long> produced(n), consumed(n);
+
+	for (int i = 0; i < n; i++) {
+		const Item& item = items[i];
+		const TransformSpec* specs[] = {
+			Transformer::producer_spec(item.opcode),
+			Transformer::consumer_spec(item.opcode)
+		};
+		unsigned long long (*kernels[])(char, unsigned long long) = {
+			Transformer::producer_iterate,
+			Transformer::consumer_iterate
+		};
+
+		// the consumer stage works on the producer's output
+		unsigned long long val = item.val;
+		for (int stage = 0; stage < 2; stage++) {
+			unsigned long long expected = Transformer::iterate(specs[stage], val);
+			unsigned long long jumped = Transformer::jump(specs[stage], val);
+			unsigned long long kernel = kernels[stage](item.opcode, val);
+			if (jumped != expected || kernel != expected) {
+				printf("key %d opcode %c: jump %llu, kernel %llu != iterate %llu\n",
+					item.key, item.opcode, jumped, kernel, expected);
+				failed++;
+			}
+			checked++;
+			val = expected;
+		}
+		produced[i] = Transformer::iterate(specs[0], item.val);
+		consumed[i] = val;
+	}
+
+	// the batch kernels, on every value of the input at once per opcode
+	const char* isas[] = {"scalar", "avx2", "avx512"};
+	TransformMode modes[] = {TRANSFORM_JUMP_AHEAD, TRANSFORM_ITERATIVE};
+
+	for (const char* isa : isas) {
+		if (!Transformer::set_batch_isa(isa)) {
+			printf("%s: not supported, skipped\n", isa);
+			continue;
+		}
+
+		for (TransformMode mode : modes) {
+			Transformer transformer(mode);
+			for (char opcode = 'A'; opcode <= 'Z'; opcode++) {
+				std::vector<int> index;
+				std::vector<unsigned long long> vals;
+				for (int i = 0; i < n; i++) {
+					if (items[i].opcode == opcode) {
+						index.push_back(i);
+						vals.push_back(items[i].val);
+					}
+				}
+				if (index.empty())
+					continue;
+
+				transformer.producer_transform_batch(opcode, vals.data(), vals.size());
+				for (size_t j = 0; j < index.size(); j++) {
+					if (vals[j] != produced[index[j]]) {
+						printf("%s: producer batch of %c: %llu != %llu\n", isa, opcode, vals[j], produced[index[j]]);
+						failed++;
+					}
+				}
+
+				transformer.consumer_transform_batch(opcode, vals.data(), vals.size());
+				for (size_t j = 0; j < index.size(); j++) {
+					if (vals[j] != consumed[index[j]]) {
+						printf("%s: consumer batch of %c: %llu != %llu\n", isa, opcode, vals[j], consumed[index[j]]);
+						failed++;
+					}
+				}
+				checked += 2 * index.size();
+			}
+		}
+	}
+
+	printf("%d transforms checked, %d mismatched\n", checked, failed);
+
+	return failed ? 1 : 0;
+}
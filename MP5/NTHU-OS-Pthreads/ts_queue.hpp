@@ -1,12 +1,20 @@
 #include <pthread.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <new>
+#include <algorithm>
+#include "queue.hpp"
+#include "wait_policy.hpp"
 
 #ifndef TS_QUEUE_HPP
 #define TS_QUEUE_HPP
 
 #define DEFAULT_BUFFER_SIZE 200
 
-template <class T>
-class TSQueue {
+// WaitPolicy is how the threads wait on a full or an empty queue,
+// CondWaitPolicy or SpinFutexWaitPolicy (see wait_policy.hpp)
+template <class T, class WaitPolicy = CondWaitPolicy>
+class TSQueue : public Queue<T> {
 public:
 	// constructor
 	TSQueue();
@@ -17,17 +25,33 @@ public:
 	~TSQueue();
 
 	// add an element to the end of the queue
-	void enqueue(T item);
+	virtual void enqueue(T item) override;
 
 	// remove and return the first element of the queue
-	T dequeue();
+	virtual T dequeue() override;
+
+	// add n elements under one lock round-trip
+	virtual void enqueue_bulk(T* items, int n) override;
+
+	// remove up to max elements under one lock round-trip
+	virtual int dequeue_bulk(T* items, int max, const std::atomic<bool>* cancel = nullptr) override;
+
+	// wake the threads blocked in dequeue_bulk
+	virtual void wake_dequeuers() override;
 
 	// return the number of elements in the queue
-	int get_size();
+	virtual int get_size() override;
+
+	// update watermark with the size after every change
+	virtual bool set_watermark(Watermark* watermark) override;
+
+	// profile the mutex and the waits, in a TS_QUEUE_PROFILE build
+	virtual bool set_profile(LockProfile* profile) override;
 private:
 	// the maximum buffer size
 	int buffer_size;
-	// the buffer containing values of the queue
+	// the buffer containing values of the queue, aligned to a cache line so
+	// that no slot straddles two when the elements are Items by value
 	T* buffer;
 	// the current size of the buffer
 	int size;
@@ -38,88 +62,240 @@ private:
 
 	// pthread mutex lock
 	pthread_mutex_t mutex;
-	// pthread conditional variable
-	pthread_cond_t cond_enqueue, cond_dequeue;
+	// the waiters for room and for items
+	WaitPolicy cond_enqueue, cond_dequeue;
+
+	Watermark* watermark;
+
+	LockProfile* profile;
+	// when the mutex was last taken, under the mutex
+	long long locked_ns;
+
+	// take and give back the mutex, profiled
+	void lock();
+	void unlock();
+
+	// wait on waiter for room (enqueue) or for items, wakeups being how many
+	// times the caller has already woken up to find the queue unchanged
+	void wait_for(WaitPolicy* waiter, bool enqueue, int wakeups);
 };
 
 // Implementation start
 
-template <class T>
-TSQueue<T>::TSQueue() : TSQueue(DEFAULT_BUFFER_SIZE) {
+template <class T, class WaitPolicy>
+TSQueue<T, WaitPolicy>::TSQueue() : TSQueue(DEFAULT_BUFFER_SIZE) {
 }
 
-template <class T>
-TSQueue<T>::TSQueue(int buffer_size) : buffer_size(buffer_size) {
-	// TODO: implements TSQueue constructor
-	buffer = new T[buffer_size];
+template <class T, class WaitPolicy>
+TSQueue<T, WaitPolicy>::TSQueue(int buffer_size) : buffer_size(buffer_size), watermark(nullptr),
+	profile(nullptr), locked_ns(0) {
+	void* memory = nullptr;
+	int error = posix_memalign(&memory, CACHE_LINE_SIZE, sizeof(T) * buffer_size);
+	assert(!error);
+	buffer = (T*)memory;
+	for (int i = 0; i < buffer_size; i++)
+		new (&buffer[i]) T();
 	size = 0;
 	head = 0;
 	tail = 0;
 
 	//Initialize a Mutex
 	pthread_mutex_init(&mutex, nullptr);
-	//for cond variable
-	pthread_cond_init(&cond_enqueue, nullptr);
-	pthread_cond_init(&cond_dequeue, nullptr);
 	
 
 	
 }
 
-template <class T>
-TSQueue<T>::~TSQueue() {
-	// TODO: implenents TSQueue destructor
-	delete[] buffer;
+template <class T, class WaitPolicy>
+TSQueue<T, WaitPolicy>::~TSQueue() {
+	for (int i = 0; i < buffer_size; i++)
+		buffer[i].~T();
+	free(buffer);
 	size = 0;
 	head = 0;
 	tail = 0;
 
 	pthread_mutex_destroy(&mutex);
-	pthread_cond_destroy(&cond_enqueue);
-	pthread_cond_destroy(&cond_dequeue);
 }
 
-template <class T>
-void TSQueue<T>::enqueue(T item) {
-	// TODO: enqueues an element to the end of the queue
-	pthread_mutex_lock(&mutex);
+template <class T, class WaitPolicy>
+void TSQueue<T, WaitPolicy>::enqueue(T item) {
+	lock();
 
 	//put the thread into sleep and release the lock
+	int wakeups = 0;
 	while(size >= buffer_size -1 ){ // 109062233
-		pthread_cond_wait(&cond_enqueue, &mutex);
+		wait_for(&cond_enqueue, true, wakeups++);
 	}
 	//re-acquire the lock
 	buffer[tail] = item;
 	tail = (tail + 1) % buffer_size;
 	size++;
-	pthread_cond_signal(&cond_dequeue);
-	pthread_mutex_unlock(&mutex);
+	if (this->stats)
+		this->stats->record_enqueue(1, size);
+	if (watermark)
+		watermark->update(size);
+	cond_dequeue.notify_one();
+	unlock();
 }
 
-template <class T>
-T TSQueue<T>::dequeue() {
-	// TODO: dequeues the first element of the queue
-	pthread_mutex_lock(&mutex);
+template <class T, class WaitPolicy>
+T TSQueue<T, WaitPolicy>::dequeue() {
+	lock();
 
+	int wakeups = 0;
 	while(size <= 0){
-		pthread_cond_wait(&cond_dequeue, &mutex);
+		wait_for(&cond_dequeue, false, wakeups++);
 	}
 	T ret_T;
 	ret_T = buffer[head];
 	head = (head + 1) % buffer_size;
 	size--;
+	if (this->stats)
+		this->stats->record_dequeue(1, size);
+	if (watermark)
+		watermark->update(size);
 	
-	pthread_cond_signal(&cond_enqueue);
+	cond_enqueue.notify_one();
 	
-	pthread_mutex_unlock(&mutex);
+	unlock();
 
 	return ret_T;
 }
 
-template <class T>
-int TSQueue<T>::get_size() {
-	// TODO: returns the size of the queue
+template <class T, class WaitPolicy>
+void TSQueue<T, WaitPolicy>::enqueue_bulk(T* items, int n) {
+	lock();
+
+	while (n > 0) {
+		int wakeups = 0;
+		while (size >= buffer_size - 1) {
+			wait_for(&cond_enqueue, true, wakeups++);
+		}
+
+		// copy as much as fits, in at most two contiguous ranges of the ring
+		int count = std::min(n, buffer_size - 1 - size);
+		int first = std::min(count, buffer_size - tail);
+		std::copy(items, items + first, buffer + tail);
+		std::copy(items + first, items + count, buffer);
+		tail = (tail + count) % buffer_size;
+		size += count;
+		items += count;
+		n -= count;
+		if (this->stats)
+			this->stats->record_enqueue(count, size);
+		if (watermark)
+			watermark->update(size);
+
+		// wake every consumer at once, there may be more than one item for them
+		cond_dequeue.notify_all();
+	}
+
+	unlock();
+}
+
+template <class T, class WaitPolicy>
+int TSQueue<T, WaitPolicy>::dequeue_bulk(T* items, int max, const std::atomic<bool>* cancel) {
+	lock();
+
+	int wakeups = 0;
+	while (size <= 0) {
+		// checked under the lock wake_dequeuers takes, so a wake-up is never missed
+		if (cancel && cancel->load()) {
+			unlock();
+			return 0;
+		}
+		wait_for(&cond_dequeue, false, wakeups++);
+	}
+
+	int count = std::min(max, size);
+	int first = std::min(count, buffer_size - head);
+	std::copy(buffer + head, buffer + head + first, items);
+	std::copy(buffer, buffer + count - first, items + first);
+	head = (head + count) % buffer_size;
+	size -= count;
+	if (this->stats)
+		this->stats->record_dequeue(count, size);
+	if (watermark)
+		watermark->update(size);
+
+	cond_enqueue.notify_all();
+
+	unlock();
+
+	return count;
+}
+
+template <class T, class WaitPolicy>
+void TSQueue<T, WaitPolicy>::wake_dequeuers() {
+	lock();
+	cond_dequeue.notify_all();
+	unlock();
+}
+
+template <class T, class WaitPolicy>
+int TSQueue<T, WaitPolicy>::get_size() {
 	return size;
 }
 
+template <class T, class WaitPolicy>
+bool TSQueue<T, WaitPolicy>::set_watermark(Watermark* watermark) {
+	lock();
+	this->watermark = watermark;
+	if (watermark)
+		watermark->update(size);
+	unlock();
+	return true;
+}
+
+template <class T, class WaitPolicy>
+bool TSQueue<T, WaitPolicy>::set_profile(LockProfile* profile) {
+	this->profile = profile;
+	return TS_QUEUE_PROFILE;
+}
+
+template <class T, class WaitPolicy>
+void TSQueue<T, WaitPolicy>::lock() {
+	if (!TS_QUEUE_PROFILE || !profile) {
+		pthread_mutex_lock(&mutex);
+		return;
+	}
+
+	LockProfile::Role& role = profile->roles[thread_role];
+	if (pthread_mutex_trylock(&mutex) != 0) {
+		long long begin = now_ns();
+		pthread_mutex_lock(&mutex);
+		role.contended.fetch_add(1, std::memory_order_relaxed);
+		role.lock_wait_ns.fetch_add(now_ns() - begin, std::memory_order_relaxed);
+	}
+	role.acquired.fetch_add(1, std::memory_order_relaxed);
+	locked_ns = now_ns();
+}
+
+template <class T, class WaitPolicy>
+void TSQueue<T, WaitPolicy>::unlock() {
+	if (TS_QUEUE_PROFILE && profile)
+		profile->roles[thread_role].hold_ns.fetch_add(now_ns() - locked_ns, std::memory_order_relaxed);
+	pthread_mutex_unlock(&mutex);
+}
+
+template <class T, class WaitPolicy>
+void TSQueue<T, WaitPolicy>::wait_for(WaitPolicy* waiter, bool enqueue, int wakeups) {
+	if (!TS_QUEUE_PROFILE || !profile) {
+		this->wait(waiter, &mutex, enqueue);
+		return;
+	}
+
+	// the mutex is not held while waiting
+	LockProfile::Role& role = profile->roles[thread_role];
+	long long begin = now_ns();
+	role.hold_ns.fetch_add(begin - locked_ns, std::memory_order_relaxed);
+	if (wakeups > 0)
+		role.spurious_wakeups.fetch_add(1, std::memory_order_relaxed);
+	this->wait(waiter, &mutex, enqueue);
+	locked_ns = now_ns();
+	role.cond_waits.fetch_add(1, std::memory_order_relaxed);
+	role.cond_wait_ns.fetch_add(locked_ns - begin, std::memory_order_relaxed);
+}
+
 #endif // TS_QUEUE_HPP
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <pthread.h>
 #include <assert.h>
+#include <unistd.h>
 #include "ts_queue.hpp"
 
 /* Global shared variables */
@@ -33,6 +34,41 @@ void* consume(void* arg) {
 	return nullptr;
 }
 
+void* fill(void* arg) {
+	TSQueue<int>* marked = (TSQueue<int>*)arg;
+
+	usleep(10000);
+	for (int i = 0; i < 11; i++)
+		marked->enqueue(i);
+
+	return nullptr;
+}
+
+// the watermark follows the depth of a queue across its marks,
+// and wakes a waiter when the band changes
+void test_watermark() {
+	TSQueue<int> marked(20);
+	Watermark watermark(3, 10);
+	assert(marked.set_watermark(&watermark));
+	assert(watermark.get_band() == BAND_EMPTY);
+	assert(!watermark.wait(BAND_EMPTY, 1000));
+
+	pthread_t t;
+	pthread_create(&t, 0, fill, (void*)&marked);
+	assert(watermark.wait(BAND_EMPTY, -1));
+	pthread_join(t, 0);
+	assert(watermark.get_band() == BAND_HIGH);
+
+	int items[20];
+	assert(marked.dequeue_bulk(items, 5) == 5);
+	assert(watermark.get_band() == BAND_WITHIN);
+	assert(marked.dequeue_bulk(items, 4) == 4);
+	assert(watermark.get_band() == BAND_LOW);
+	assert(watermark.wait(BAND_HIGH, -1));
+
+	marked.set_watermark(nullptr);
+}
+
 struct Thread {
 	pthread_t t;
 	int id;
@@ -76,5 +112,7 @@ int main(int argc, char** argv) {
 		printf("\n");
 	}
 
+	test_watermark();
+
 	return 0;
 }
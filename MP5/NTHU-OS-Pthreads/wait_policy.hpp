@@ -0,0 +1,99 @@
+#include <pthread.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <atomic>
+#include "lf_queue.hpp"
+
+#ifndef WAIT_POLICY_HPP
+#define WAIT_POLICY_HPP
+
+// How a TSQueue waits for room or for items, one waiter per side of the
+// queue. wait is called with the queue mutex held and returns with it held,
+// maybe spuriously; notify_one and notify_all are called with it held.
+
+// pthread_cond_wait, and a signal on every operation
+class CondWaitPolicy {
+public:
+	CondWaitPolicy() {
+		pthread_cond_init(&cond, nullptr);
+	}
+
+	~CondWaitPolicy() {
+		pthread_cond_destroy(&cond);
+	}
+
+	void wait(pthread_mutex_t* mutex) {
+		pthread_cond_wait(&cond, mutex);
+	}
+
+	void notify_one() {
+		pthread_cond_signal(&cond);
+	}
+
+	void notify_all() {
+		pthread_cond_broadcast(&cond);
+	}
+private:
+	pthread_cond_t cond;
+};
+
+// Spin on a sequence number for a while with the mutex released, then sleep
+// on it with a futex. A notify only bumps the sequence if a thread waits,
+// and only makes the futex syscall if a thread sleeps, so a queue that is
+// neither full nor empty never leaves user space.
+class SpinFutexWaitPolicy {
+public:
+	SpinFutexWaitPolicy() : seq(0), sleepers(0), waiters(0) {}
+
+	~SpinFutexWaitPolicy() {}
+
+	void wait(pthread_mutex_t* mutex) {
+		// read under the mutex, so a notify after the unlock changes it
+		int old = seq.load(std::memory_order_relaxed);
+		waiters++;
+		pthread_mutex_unlock(mutex);
+
+		for (int spin = 0; spin < spin_count() && seq.load(std::memory_order_acquire) == old; spin++)
+			cpu_relax();
+
+		if (seq.load(std::memory_order_acquire) == old) {
+			// paired with the seq_cst bump and load in wake: either the notify
+			// sees the sleeper or the futex sees the new sequence
+			sleepers.fetch_add(1, std::memory_order_seq_cst);
+			while (seq.load(std::memory_order_seq_cst) == old)
+				syscall(SYS_futex, (int*)&seq, FUTEX_WAIT_PRIVATE, old, nullptr, nullptr, 0);
+			sleepers.fetch_sub(1, std::memory_order_relaxed);
+		}
+
+		pthread_mutex_lock(mutex);
+		waiters--;
+	}
+
+	void notify_one() {
+		wake(1);
+	}
+
+	void notify_all() {
+		wake(INT_MAX);
+	}
+private:
+	// bumped by every notify with a waiter, the futex word
+	std::atomic<int> seq;
+	// the waiters sleeping in the futex
+	std::atomic<int> sleepers;
+	// the waiters spinning or sleeping, guarded by the queue mutex
+	int waiters;
+
+	void wake(int count) {
+		if (waiters == 0)
+			return;
+
+		seq.fetch_add(1, std::memory_order_seq_cst);
+		if (sleepers.load(std::memory_order_seq_cst) > 0)
+			syscall(SYS_futex, (int*)&seq, FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+	}
+};
+
+#endif // WAIT_POLICY_HPP
@@ -0,0 +1,117 @@
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+#include <assert.h>
+#include <atomic>
+
+#ifndef WATERMARK_HPP
+#define WATERMARK_HPP
+
+// The band the depth of a queue is in, between its low and high marks.
+enum WatermarkBand {
+	BAND_EMPTY,
+	// more than nothing, fewer than low
+	BAND_LOW,
+	// from low up to high
+	BAND_WITHIN,
+	// more than high
+	BAND_HIGH
+};
+
+// Notifies a thread when the depth of a queue moves to another band, so it can
+// block until the load changes instead of polling get_size.
+// The queue updates it with every change of its depth, under its own lock.
+// Moving to another band signals an eventfd, but only while a thread is armed
+// in wait: a queue going back and forth across a mark costs one compare per
+// operation, not a write(2) each time.
+class Watermark {
+public:
+	// constructor, for an empty queue
+	Watermark(int low, int high);
+
+	// destructor
+	~Watermark();
+
+	// the depth of the queue after a change, called by the queue under its lock
+	void update(int depth);
+
+	// the band the depth is in now
+	WatermarkBand get_band();
+
+	// block until the band is no longer band or for timeout microseconds,
+	// -1 for no timeout, returns false on the timeout
+	bool wait(WatermarkBand band, int timeout);
+private:
+	int low;
+	int high;
+	int fd;
+
+	std::atomic<int> band;
+	// whether a thread is waiting for the band to change
+	std::atomic<bool> armed;
+
+	WatermarkBand band_of(int depth);
+};
+
+// Implementation start
+
+Watermark::Watermark(int low, int high) : low(low), high(high), band(BAND_EMPTY), armed(false) {
+	fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	assert(fd >= 0);
+}
+
+Watermark::~Watermark() {
+	close(fd);
+}
+
+WatermarkBand Watermark::band_of(int depth) {
+	if (depth <= 0)
+		return BAND_EMPTY;
+	if (depth < low)
+		return BAND_LOW;
+	if (depth <= high)
+		return BAND_WITHIN;
+	return BAND_HIGH;
+}
+
+void Watermark::update(int depth) {
+	int next = band_of(depth);
+	if (next == band.load(std::memory_order_relaxed))
+		return;
+
+	// the store and the load of armed pair with the ones in wait, so either
+	// the waiter sees the new band or this sees it armed
+	band.store(next);
+	if (armed.load() && armed.exchange(false)) {
+		uint64_t one = 1;
+		ssize_t written = write(fd, &one, sizeof(one));
+		assert(written == sizeof(one));
+	}
+}
+
+WatermarkBand Watermark::get_band() {
+	return (WatermarkBand)band.load();
+}
+
+bool Watermark::wait(WatermarkBand band, int timeout) {
+	// drop a signal left over from a wait that timed out
+	uint64_t count;
+	while (read(fd, &count, sizeof(count)) > 0) {
+	}
+
+	armed.store(true);
+	if (this->band.load() != band) {
+		armed.store(false);
+		return true;
+	}
+
+	struct pollfd event = {fd, POLLIN, 0};
+	struct timespec limit = {timeout / 1000000, timeout % 1000000 * 1000L};
+	int ready = ppoll(&event, 1, timeout < 0 ? nullptr : &limit, nullptr);
+	armed.store(false);
+	return ready > 0;
+}
+
+#endif // WATERMARK_HPP
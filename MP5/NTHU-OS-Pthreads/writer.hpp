@@ -1,57 +1,351 @@
 #include <fstream>
-#include "thread.hpp"
-#include "ts_queue.hpp"
+#include <algorithm>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "stage.hpp"
+#include "queue.hpp"
 #include "item.hpp"
+#include "record.hpp"
+#include "checkpoint.hpp"
 
 #ifndef WRITER_HPP
 #define WRITER_HPP
 
-class Writer : public Thread {
+// the size of each output buffer of the buffered modes
+#define WRITER_BUFFER_SIZE (4 << 20)
+
+enum WriterMode {
+	// std::ofstream and Item's operator<<
+	WRITER_STREAM,
+	// format_item into a large buffer, written out with write(2) when full
+	WRITER_BUFFERED,
+	// two buffers: a flush thread writes one while the writer fills the other
+	WRITER_DOUBLE_BUFFERED,
+	// like WRITER_BUFFERED, records (record.hpp) after a header instead of lines
+	WRITER_BINARY
+};
+
+// The sink stage: writes the items out and gives them back to the pool.
+// E is how the queues carry the items, Item* (a Writer) or Item, which needs no pool.
+template <class E>
+class BasicWriter : public Stage<E, E> {
 public:
 	// constructor
-	Writer(int expected_lines, std::string output_file, TSQueue<Item*>* output_queue);
+	BasicWriter(int expected_lines, std::string output_file, Queue<E>* output_queue, int batch_size = 1,
+		ItemPool* item_pool = nullptr, WriterMode mode = WRITER_STREAM);
 
 	// destructor
-	~Writer();
+	~BasicWriter();
 
 	virtual void start() override;
+
+	// record the end-to-end latency of every item in microseconds into latency,
+	// from the times the Reader stamped into read_times
+	void set_latency(Histogram* latency, ReadTimes* read_times);
+
+	// save checkpoint every period items written, resuming from what it
+	// loaded: the output past its offset is dropped and only the items not
+	// written are expected, before start and not in WRITER_STREAM
+	void set_checkpoint(Checkpoint* checkpoint, int period);
+protected:
+	virtual void begin() override;
+	virtual void finish() override;
+
+	// up to max items of the output queue, -1 after the expected lines
+	virtual int pull(E* items, int max) override;
+
+	// write the items out, there are no outputs
+	virtual int work(E* items, int n, E* outputs) override;
 private:
 	// the expected lines to write,
 	// the writer thread finished after output expected lines of item
 	int expected_lines;
 
 	std::ofstream ofs;
-	TSQueue<Item*> *output_queue;
 
-	// the method for pthread to create a writer thread
-	static void* process(void* arg);
+	// where the written items go back to, items are deleted without a pool
+	ItemPool::Cache cache;
+
+	WriterMode mode;
+
+	Histogram* latency;
+	ReadTimes* read_times;
+
+	Checkpoint* checkpoint;
+	int checkpoint_period;
+	// the items written since the last save
+	int unsaved;
+	// where the output starts, past what the checkpoint resumed from
+	size_t resume_offset;
+
+	// the output file of the buffered modes
+	int fd;
+	// the buffers, the one being filled and how much of it is
+	char* buffers[2];
+	int current;
+	size_t used;
+
+	// the hand-off to the flush thread of WRITER_DOUBLE_BUFFERED
+	pthread_t flush_t;
+	pthread_mutex_t flush_mutex;
+	pthread_cond_t flush_cond;
+	// the buffer the flush thread is writing, nullptr when it is idle
+	char* flush_buffer;
+	size_t flush_size;
+	bool flush_stop;
+
+	// write one item in the current mode
+	void write_item(const Item& item);
+
+	// write out the current buffer, or hand it to the flush thread
+	void flush();
+
+	// flush and wait for the flush thread to be idle
+	void drain();
+
+	// make the output written so far durable and save the checkpoint
+	void save_checkpoint();
+
+	// write(2) all of [buffer, buffer + size)
+	void write_all(const char* buffer, size_t size);
+
+	// the method for pthread to create the flush thread
+	static void* flush_process(void* arg);
 };
 
+typedef BasicWriter<Item*> Writer;
+
 // Implementation start
 
-Writer::Writer(int expected_lines, std::string output_file, TSQueue<Item*>* output_queue)
-	: expected_lines(expected_lines), output_queue(output_queue) {
-	ofs = std::ofstream(output_file);
+template <class E>
+BasicWriter<E>::BasicWriter(int expected_lines, std::string output_file, Queue<E>* output_queue, int batch_size,
+	ItemPool* item_pool, WriterMode mode)
+	: Stage<E, E>(output_queue, nullptr, batch_size), expected_lines(expected_lines), cache(item_pool),
+	mode(mode), latency(nullptr), read_times(nullptr), checkpoint(nullptr), checkpoint_period(0), unsaved(0),
+	resume_offset(0), fd(-1), current(0), used(0), flush_buffer(nullptr), flush_size(0), flush_stop(false) {
+	buffers[0] = buffers[1] = nullptr;
+	this->role = ROLE_WRITER;
+
+	if (mode == WRITER_STREAM) {
+		ofs = std::ofstream(output_file);
+		return;
+	}
+
+	// truncated by begin, to where a checkpoint resumes
+	fd = open(output_file.c_str(), O_WRONLY | O_CREAT, 0644);
+	assert(fd >= 0);
+
+	buffers[0] = new char[WRITER_BUFFER_SIZE];
+	if (mode == WRITER_DOUBLE_BUFFERED) {
+		buffers[1] = new char[WRITER_BUFFER_SIZE];
+		pthread_mutex_init(&flush_mutex, nullptr);
+		pthread_cond_init(&flush_cond, nullptr);
+	}
+	if (mode == WRITER_BINARY)
+		used = write_record_header(buffers[0]) - buffers[0];
+}
+
+template <class E>
+BasicWriter<E>::~BasicWriter() {
+	if (mode == WRITER_STREAM) {
+		ofs.close();
+		return;
+	}
+
+	close(fd);
+	delete[] buffers[0];
+	delete[] buffers[1];
+	if (mode == WRITER_DOUBLE_BUFFERED) {
+		pthread_mutex_destroy(&flush_mutex);
+		pthread_cond_destroy(&flush_cond);
+	}
 }
 
-Writer::~Writer() {
-	ofs.close();
+template <class E>
+void BasicWriter<E>::start() {
+	if (mode == WRITER_DOUBLE_BUFFERED)
+		pthread_create(&flush_t, 0, BasicWriter::flush_process, (void*)this);
+	Stage<E, E>::start();
 }
 
-void Writer::start() {
-	// TODO: starts a Writer thread
-	pthread_create(&t, 0, Writer::process, (void*)this);
+template <class E>
+void BasicWriter<E>::set_latency(Histogram* latency, ReadTimes* read_times) {
+	this->latency = latency;
+	this->read_times = read_times;
 }
 
-void* Writer::process(void* arg) {
-	// TODO: implements the Writer's work
-	Writer* writer = (Writer*)arg;
-	while(writer->expected_lines--){
-		Item *item = writer->output_queue->dequeue();
-		writer->ofs << *item;
-		
+template <class E>
+void BasicWriter<E>::set_checkpoint(Checkpoint* checkpoint, int period) {
+	assert(mode != WRITER_STREAM);
+	this->checkpoint = checkpoint;
+	checkpoint_period = period;
+	expected_lines -= checkpoint->get_resumed();
+	resume_offset = checkpoint->get_offset();
+	// the header of WRITER_BINARY is in the output already
+	if (resume_offset > 0)
+		used = 0;
+}
+
+template <class E>
+void BasicWriter<E>::begin() {
+	if (mode == WRITER_STREAM)
+		return;
+
+	int error = ftruncate(fd, resume_offset);
+	assert(!error);
+	lseek(fd, resume_offset, SEEK_SET);
+}
+
+template <class E>
+void BasicWriter<E>::write_all(const char* buffer, size_t size) {
+	while (size > 0) {
+		ssize_t written = write(fd, buffer, size);
+		assert(written > 0);
+		buffer += written;
+		size -= written;
 	}
+}
+
+template <class E>
+void BasicWriter<E>::flush() {
+	if (used == 0)
+		return;
+
+	if (mode != WRITER_DOUBLE_BUFFERED) {
+		write_all(buffers[0], used);
+		used = 0;
+		return;
+	}
+
+	// wait for the flush thread to be done with the other buffer,
+	// then hand it this one and keep filling the other
+	pthread_mutex_lock(&flush_mutex);
+	while (flush_buffer) {
+		pthread_cond_wait(&flush_cond, &flush_mutex);
+	}
+	flush_buffer = buffers[current];
+	flush_size = used;
+	pthread_cond_broadcast(&flush_cond);
+	pthread_mutex_unlock(&flush_mutex);
+
+	current ^= 1;
+	used = 0;
+}
+
+template <class E>
+void BasicWriter<E>::drain() {
+	flush();
+	if (mode != WRITER_DOUBLE_BUFFERED)
+		return;
+
+	pthread_mutex_lock(&flush_mutex);
+	while (flush_buffer) {
+		pthread_cond_wait(&flush_cond, &flush_mutex);
+	}
+	pthread_mutex_unlock(&flush_mutex);
+}
+
+template <class E>
+void BasicWriter<E>::save_checkpoint() {
+	drain();
+	fdatasync(fd);
+	checkpoint->save(lseek(fd, 0, SEEK_CUR));
+	unsaved = 0;
+}
+
+template <class E>
+void* BasicWriter<E>::flush_process(void* arg) {
+	BasicWriter* writer = (BasicWriter*)arg;
+
+	pthread_mutex_lock(&writer->flush_mutex);
+	while (1) {
+		while (!writer->flush_buffer && !writer->flush_stop) {
+			pthread_cond_wait(&writer->flush_cond, &writer->flush_mutex);
+		}
+		if (!writer->flush_buffer)
+			break;
+
+		pthread_mutex_unlock(&writer->flush_mutex);
+		writer->write_all(writer->flush_buffer, writer->flush_size);
+		pthread_mutex_lock(&writer->flush_mutex);
+
+		writer->flush_buffer = nullptr;
+		pthread_cond_broadcast(&writer->flush_cond);
+	}
+	pthread_mutex_unlock(&writer->flush_mutex);
+
 	return nullptr;
 }
 
+template <class E>
+void BasicWriter<E>::write_item(const Item& item) {
+	if (mode == WRITER_STREAM) {
+		ofs << item;
+		return;
+	}
+
+	if (used + ITEM_MAX_TEXT_LENGTH > WRITER_BUFFER_SIZE)
+		flush();
+	char* buffer = buffers[current];
+	if (mode == WRITER_BINARY)
+		used = write_record(buffer + used, item) - buffer;
+	else
+		used = format_item(buffer + used, item) - buffer;
+}
+
+template <class E>
+int BasicWriter<E>::pull(E* items, int max) {
+	if (expected_lines == 0)
+		return -1;
+
+	int n = this->input_queue->dequeue_bulk(items, std::min(max, expected_lines), &this->is_cancel);
+	expected_lines -= n;
+	return n;
+}
+
+template <class E>
+int BasicWriter<E>::work(E* items, int n, E*) {
+	long long now = latency ? now_ns() : 0;
+	for (int i = 0; i < n; i++) {
+		const Item& item = item_ref(items[i]);
+		if (latency) {
+			long long read_time = read_times->get(item.key);
+			if (read_time)
+				latency->record((now - read_time) / 1000);
+		}
+		write_item(item);
+		if (checkpoint) {
+			checkpoint->mark(item.key);
+			unsaved++;
+		}
+		release_item(cache, items[i]);
+	}
+
+	if (checkpoint && unsaved >= checkpoint_period)
+		save_checkpoint();
+	return 0;
+}
+
+template <class E>
+void BasicWriter<E>::finish() {
+	if (mode != WRITER_STREAM)
+		flush();
+
+	// the output is complete once the flush thread is gone
+	if (mode == WRITER_DOUBLE_BUFFERED) {
+		pthread_mutex_lock(&flush_mutex);
+		flush_stop = true;
+		pthread_cond_broadcast(&flush_cond);
+		pthread_mutex_unlock(&flush_mutex);
+		pthread_join(flush_t, 0);
+	}
+
+	// every item is written and durable, there is nothing to resume
+	if (checkpoint) {
+		fdatasync(fd);
+		checkpoint->remove();
+	}
+}
+
 #endif // WRITER_HPP
@@ -0,0 +1,398 @@
+#include <pthread.h>
+#include <atomic>
+#include <vector>
+#include "queue.hpp"
+#include "lf_queue.hpp"
+
+#ifndef WS_QUEUE_HPP
+#define WS_QUEUE_HPP
+
+#define DEFAULT_WS_BUFFER_SIZE 200
+#define DEFAULT_WS_DEQUES 16
+
+// A work-stealing queue: one Chase-Lev deque per dequeuing thread instead
+// of a single shared ring.
+//
+// Every thread that dequeues is given a deque of its own the first time it
+// does. It takes items from the bottom of that deque, and when it runs dry
+// it steals from the top of the other deques with a CAS, so idle consumers
+// drain the deques of busy (or parked) ones. Enqueuers push every batch to
+// the less loaded of two deques picked at random.
+//
+// In the Chase-Lev deque only the owner pushes and pops at the bottom.
+// Here the enqueuers push at the bottom too, so the bottom end of each
+// deque is guarded by its own mutex: the enqueuers and the owner of one
+// deque serialize among themselves, while thieves never take a lock.
+//
+// The deques are fixed rings of a power of two slots, together holding at
+// least the requested size. get_size is the backlog summed over all of them.
+template <class T>
+class WSQueue : public Queue<T> {
+public:
+	// constructor
+	WSQueue();
+
+	explicit WSQueue(int max_buffer_size, int num_deques = DEFAULT_WS_DEQUES);
+
+	// destructor
+	~WSQueue();
+
+	// add an element to a deque
+	virtual void enqueue(T item) override;
+
+	// remove an element from the own deque or steal one
+	virtual T dequeue() override;
+
+	// add n elements, as many as fit into one deque at a time
+	virtual void enqueue_bulk(T* items, int n) override;
+
+	// remove up to max elements from the own deque, or steal them
+	virtual int dequeue_bulk(T* items, int max, const std::atomic<bool>* cancel = nullptr) override;
+
+	// wake the threads sleeping in dequeue_bulk
+	virtual void wake_dequeuers() override;
+
+	// return the number of elements in all the deques
+	virtual int get_size() override;
+
+	// the number of elements in deque index, and how many deques there are
+	int get_deque_size(int index);
+	int get_deques();
+private:
+	struct Deque {
+		// the top is only moved by a CAS, by the thieves and the owner
+		// taking the last item; the bottom only under bottom_mutex
+		std::atomic<long> top;
+		char pad0[CACHE_LINE_SIZE];
+		std::atomic<long> bottom;
+		pthread_mutex_t bottom_mutex;
+		std::atomic<T>* slots;
+		char pad1[CACHE_LINE_SIZE];
+	};
+
+	// push up to n items to the bottom of deque, return how many fit
+	int push(Deque& deque, T* items, int n);
+
+	// pop up to max items from the bottom of deque, return how many there were
+	int pop(Deque& deque, T* items, int max);
+
+	// steal up to max items from the top of deque
+	int steal(Deque& deque, T* items, int max);
+
+	// take items from the own deque, or else steal them from the others in turn
+	int take(T* items, int max);
+
+	// the deque of the calling thread
+	int own_deque();
+
+	// the less loaded of two random deques
+	int pick_deque();
+
+	// wake up the sleeping threads if there is any
+	void notify(std::atomic<int>& waiters, pthread_cond_t* cond);
+
+	long deque_size(Deque& deque);
+
+	Deque* deques;
+	int num_deques;
+	// the slots of each deque, a power of two
+	long deque_capacity;
+
+	// hands out the deques to the dequeuing threads
+	std::atomic<int> next_owner;
+
+	// the number of threads sleeping on a full or an empty queue
+	std::atomic<int> enqueue_waiters, dequeue_waiters;
+
+	// pthread mutex lock, only taken on the sleeping path
+	pthread_mutex_t mutex;
+	// pthread conditional variable
+	pthread_cond_t cond_enqueue, cond_dequeue;
+};
+
+// Implementation start
+
+template <class T>
+WSQueue<T>::WSQueue() : WSQueue(DEFAULT_WS_BUFFER_SIZE) {
+}
+
+template <class T>
+WSQueue<T>::WSQueue(int buffer_size, int num_deques) : num_deques(num_deques) {
+	long per_deque = (buffer_size + num_deques - 1) / num_deques;
+	deque_capacity = 1;
+	while (deque_capacity < per_deque)
+		deque_capacity *= 2;
+
+	deques = new Deque[num_deques];
+	for (int i = 0; i < num_deques; i++) {
+		deques[i].top.store(0, std::memory_order_relaxed);
+		deques[i].bottom.store(0, std::memory_order_relaxed);
+		deques[i].slots = new std::atomic<T>[deque_capacity];
+		pthread_mutex_init(&deques[i].bottom_mutex, nullptr);
+	}
+
+	next_owner.store(0, std::memory_order_relaxed);
+	enqueue_waiters.store(0, std::memory_order_relaxed);
+	dequeue_waiters.store(0, std::memory_order_relaxed);
+
+	pthread_mutex_init(&mutex, nullptr);
+	pthread_cond_init(&cond_enqueue, nullptr);
+	pthread_cond_init(&cond_dequeue, nullptr);
+}
+
+template <class T>
+WSQueue<T>::~WSQueue() {
+	for (int i = 0; i < num_deques; i++) {
+		delete[] deques[i].slots;
+		pthread_mutex_destroy(&deques[i].bottom_mutex);
+	}
+	delete[] deques;
+
+	pthread_mutex_destroy(&mutex);
+	pthread_cond_destroy(&cond_enqueue);
+	pthread_cond_destroy(&cond_dequeue);
+}
+
+template <class T>
+long WSQueue<T>::deque_size(Deque& deque) {
+	long size = deque.bottom.load(std::memory_order_relaxed) - deque.top.load(std::memory_order_relaxed);
+	return size < 0 ? 0 : size;
+}
+
+template <class T>
+int WSQueue<T>::push(Deque& deque, T* items, int n) {
+	long b = deque.bottom.load(std::memory_order_relaxed);
+	long t = deque.top.load(std::memory_order_acquire);
+	int count = (int)std::min((long)n, deque_capacity - (b - t));
+
+	for (int i = 0; i < count; i++)
+		deque.slots[(b + i) & (deque_capacity - 1)].store(items[i], std::memory_order_relaxed);
+	// publish the items to the thieves
+	deque.bottom.store(b + count, std::memory_order_release);
+	return count;
+}
+
+template <class T>
+int WSQueue<T>::pop(Deque& deque, T* items, int max) {
+	int count = 0;
+	while (count < max) {
+		long b = deque.bottom.load(std::memory_order_relaxed) - 1;
+		deque.bottom.store(b, std::memory_order_relaxed);
+		// the thieves must see the smaller bottom before we read the top
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		long t = deque.top.load(std::memory_order_relaxed);
+
+		if (t > b) {
+			// empty
+			deque.bottom.store(b + 1, std::memory_order_relaxed);
+			break;
+		}
+
+		T item = deque.slots[b & (deque_capacity - 1)].load(std::memory_order_relaxed);
+		if (t == b) {
+			// the last item, race the thieves for it on the top
+			bool won = deque.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+				std::memory_order_relaxed);
+			deque.bottom.store(b + 1, std::memory_order_relaxed);
+			if (!won)
+				break;
+			items[count++] = item;
+			break;
+		}
+		items[count++] = item;
+	}
+	return count;
+}
+
+template <class T>
+int WSQueue<T>::steal(Deque& deque, T* items, int max) {
+	int count = 0;
+	while (count < max) {
+		long t = deque.top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		long b = deque.bottom.load(std::memory_order_acquire);
+		if (t >= b)
+			break;
+
+		T item = deque.slots[t & (deque_capacity - 1)].load(std::memory_order_relaxed);
+		if (deque.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+			std::memory_order_relaxed))
+			items[count++] = item;
+		// else another thief or the owner took it, look again
+	}
+	return count;
+}
+
+template <class T>
+int WSQueue<T>::own_deque() {
+	// a thread only ever dequeues from one queue, remember which deque it got
+	static thread_local const WSQueue<T>* owner_queue = nullptr;
+	static thread_local int owner_index = 0;
+	if (owner_queue != this) {
+		owner_queue = this;
+		owner_index = next_owner.fetch_add(1, std::memory_order_relaxed) % num_deques;
+	}
+	return owner_index;
+}
+
+template <class T>
+int WSQueue<T>::pick_deque() {
+	// xorshift, seeded by the address of the thread's own seed
+	static thread_local unsigned long seed = 0;
+	if (seed == 0)
+		seed = (unsigned long)&seed | 1;
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+
+	int a = seed % num_deques;
+	int b = (seed >> 32) % num_deques;
+	return deque_size(deques[a]) <= deque_size(deques[b]) ? a : b;
+}
+
+template <class T>
+int WSQueue<T>::take(T* items, int max) {
+	int own = own_deque();
+	Deque& deque = deques[own];
+
+	pthread_mutex_lock(&deque.bottom_mutex);
+	int count = pop(deque, items, max);
+	pthread_mutex_unlock(&deque.bottom_mutex);
+	if (count > 0)
+		return count;
+
+	// fill the batch from the others, the deques of parked consumers
+	// are only ever drained this way
+	for (int i = 1; i < num_deques && count < max; i++) {
+		Deque& victim = deques[(own + i) % num_deques];
+		if (deque_size(victim) > 0)
+			count += steal(victim, items + count, max - count);
+	}
+	return count;
+}
+
+template <class T>
+void WSQueue<T>::notify(std::atomic<int>& waiters, pthread_cond_t* cond) {
+	// pairs with the fence of the sleepers, like LFQueue::notify
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (waiters.load(std::memory_order_relaxed) > 0) {
+		pthread_mutex_lock(&mutex);
+		pthread_cond_broadcast(cond);
+		pthread_mutex_unlock(&mutex);
+	}
+}
+
+template <class T>
+void WSQueue<T>::enqueue_bulk(T* items, int n) {
+	int spin = 0;
+	while (n > 0) {
+		int index = pick_deque();
+		Deque& deque = deques[index];
+
+		pthread_mutex_lock(&deque.bottom_mutex);
+		int count = push(deque, items, n);
+		pthread_mutex_unlock(&deque.bottom_mutex);
+
+		// both picks were full, look for room anywhere
+		for (int i = 1; i < num_deques && count == 0; i++) {
+			Deque& other = deques[(index + i) % num_deques];
+			pthread_mutex_lock(&other.bottom_mutex);
+			count = push(other, items, n);
+			pthread_mutex_unlock(&other.bottom_mutex);
+		}
+
+		items += count;
+		n -= count;
+		if (count > 0) {
+			if (this->stats)
+				this->stats->record_enqueue(count, get_size());
+			spin = 0;
+			continue;
+		}
+
+		if (spin++ < spin_count()) {
+			cpu_relax();
+			continue;
+		}
+
+		// every deque stays full, sleep until a dequeue makes room
+		notify(dequeue_waiters, &cond_dequeue);
+		pthread_mutex_lock(&mutex);
+		enqueue_waiters.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (get_size() >= num_deques * deque_capacity)
+			this->wait(&cond_enqueue, &mutex, true);
+		enqueue_waiters.fetch_sub(1);
+		pthread_mutex_unlock(&mutex);
+		spin = 0;
+	}
+	notify(dequeue_waiters, &cond_dequeue);
+}
+
+template <class T>
+int WSQueue<T>::dequeue_bulk(T* items, int max, const std::atomic<bool>* cancel) {
+	int count = 0;
+	int spin = 0;
+	while ((count = take(items, max)) == 0) {
+		if (cancel && cancel->load())
+			return 0;
+		if (spin++ < spin_count()) {
+			cpu_relax();
+			continue;
+		}
+
+		// every deque is empty, go to sleep until an enqueue arrives
+		pthread_mutex_lock(&mutex);
+		dequeue_waiters.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		// checked under the lock wake_dequeuers takes, so a wake-up is never missed
+		if (get_size() == 0 && !(cancel && cancel->load()))
+			this->wait(&cond_dequeue, &mutex, false);
+		dequeue_waiters.fetch_sub(1);
+		pthread_mutex_unlock(&mutex);
+		spin = 0;
+	}
+	if (this->stats)
+		this->stats->record_dequeue(count, get_size());
+	notify(enqueue_waiters, &cond_enqueue);
+	return count;
+}
+
+template <class T>
+void WSQueue<T>::enqueue(T item) {
+	enqueue_bulk(&item, 1);
+}
+
+template <class T>
+T WSQueue<T>::dequeue() {
+	T item;
+	dequeue_bulk(&item, 1);
+	return item;
+}
+
+template <class T>
+void WSQueue<T>::wake_dequeuers() {
+	pthread_mutex_lock(&mutex);
+	pthread_cond_broadcast(&cond_dequeue);
+	pthread_mutex_unlock(&mutex);
+}
+
+template <class T>
+int WSQueue<T>::get_size() {
+	long size = 0;
+	for (int i = 0; i < num_deques; i++)
+		size += deque_size(deques[i]);
+	return (int)size;
+}
+
+template <class T>
+int WSQueue<T>::get_deque_size(int index) {
+	return (int)deque_size(deques[index]);
+}
+
+template <class T>
+int WSQueue<T>::get_deques() {
+	return num_deques;
+}
+
+#endif // WS_QUEUE_HPP
@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <pthread.h>
+#include <assert.h>
+#include <unistd.h>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include "ws_queue.hpp"
+
+#define PRODUCERS 3
+#define CONSUMERS 3
+#define ITEMS 20000
+// the bulk calls move up to this many items
+#define BULK 5
+// the rounds of the race for the last item of a deque
+#define RACES 5000
+
+std::atomic<int> received[PRODUCERS * ITEMS];
+std::atomic<int> consumed;
+std::atomic<bool> done;
+
+struct Worker {
+	pthread_t t;
+	int id;
+	WSQueue<int>* queue;
+};
+
+void* produce(void* arg) {
+	Worker* worker = (Worker*)arg;
+	int batch[BULK];
+	for (int i = 0; i < ITEMS; i += BULK) {
+		int n = std::min(BULK, ITEMS - i);
+		for (int j = 0; j < n; j++)
+			batch[j] = worker->id * ITEMS + i + j;
+		worker->queue->enqueue_bulk(batch, n);
+	}
+	return nullptr;
+}
+
+void* consume(void* arg) {
+	Worker* worker = (Worker*)arg;
+	int items[BULK];
+	int n;
+	while ((n = worker->queue->dequeue_bulk(items, BULK, &done)) > 0) {
+		for (int i = 0; i < n; i++) {
+			assert(items[i] >= 0 && items[i] < PRODUCERS * ITEMS);
+			received[items[i]].fetch_add(1);
+		}
+		consumed.fetch_add(n);
+	}
+	return nullptr;
+}
+
+void reset() {
+	for (int i = 0; i < PRODUCERS * ITEMS; i++)
+		received[i].store(0);
+	consumed.store(0);
+	done.store(false);
+}
+
+// wait for count items to be consumed, then stop the consumers
+void stop_consumers(WSQueue<int>* queue, Worker* consumers, int n, int count) {
+	while (consumed.load() < count)
+		usleep(1000);
+	done.store(true);
+	queue->wake_dequeuers();
+	for (int i = 0; i < n; i++)
+		pthread_join(consumers[i].t, 0);
+	assert(consumed.load() == count);
+}
+
+// the popped and the stolen items are the pushed ones, each exactly once.
+// There are more deques than consumers, the deques nobody owns are only
+// drained by stealing.
+void test_exactly_once() {
+	WSQueue<int> queue(32, CONSUMERS + 2);
+	reset();
+
+	Worker producers[PRODUCERS], consumers[CONSUMERS];
+	for (int i = 0; i < CONSUMERS; i++) {
+		consumers[i].queue = &queue;
+		pthread_create(&consumers[i].t, 0, consume, (void*)&consumers[i]);
+	}
+	for (int i = 0; i < PRODUCERS; i++) {
+		producers[i].id = i;
+		producers[i].queue = &queue;
+		pthread_create(&producers[i].t, 0, produce, (void*)&producers[i]);
+	}
+	for (int i = 0; i < PRODUCERS; i++)
+		pthread_join(producers[i].t, 0);
+	stop_consumers(&queue, consumers, CONSUMERS, PRODUCERS * ITEMS);
+
+	for (int i = 0; i < PRODUCERS * ITEMS; i++)
+		assert(received[i].load() == 1);
+	assert(queue.get_size() == 0);
+}
+
+// a single consumer owns one deque of four: the items pushed to the
+// other three reach it by stealing only
+void test_steal() {
+	WSQueue<int> queue(64, 4);
+	reset();
+
+	int items[64];
+	for (int i = 0; i < 64; i++)
+		items[i] = i;
+	queue.enqueue_bulk(items, 64);
+	for (int i = 0; i < 4; i++)
+		assert(queue.get_deque_size(i) > 0);
+
+	Worker consumer;
+	consumer.queue = &queue;
+	pthread_create(&consumer.t, 0, consume, (void*)&consumer);
+	stop_consumers(&queue, &consumer, 1, 64);
+	for (int i = 0; i < 64; i++)
+		assert(received[i].load() == 1);
+}
+
+pthread_barrier_t round_begin, round_end;
+
+void* race(void* arg) {
+	Worker* worker = (Worker*)arg;
+	for (int round = 0; round < RACES; round++) {
+		pthread_barrier_wait(&round_begin);
+		int item;
+		if (worker->queue->dequeue_bulk(&item, 1, &done) == 1) {
+			assert(item == round);
+			received[item].fetch_add(1);
+			consumed.fetch_add(1);
+		}
+		pthread_barrier_wait(&round_end);
+	}
+	return nullptr;
+}
+
+// Two consumers owning the two deques race for one item a round: the owner
+// of the deque it was pushed to pops the last element of its deque while
+// the other one steals it, and exactly one of them gets it.
+void test_last_item_race() {
+	WSQueue<int> queue(4, 2);
+	reset();
+	pthread_barrier_init(&round_begin, nullptr, 3);
+	pthread_barrier_init(&round_end, nullptr, 3);
+
+	Worker racers[2];
+	for (int i = 0; i < 2; i++) {
+		racers[i].queue = &queue;
+		pthread_create(&racers[i].t, 0, race, (void*)&racers[i]);
+	}
+	for (int round = 0; round < RACES; round++) {
+		queue.enqueue(round);
+		pthread_barrier_wait(&round_begin);
+		while (consumed.load() < round + 1)
+			usleep(10);
+		// the loser gives up
+		done.store(true);
+		queue.wake_dequeuers();
+		pthread_barrier_wait(&round_end);
+		done.store(false);
+	}
+	for (int i = 0; i < 2; i++)
+		pthread_join(racers[i].t, 0);
+
+	assert(consumed.load() == RACES && queue.get_size() == 0);
+	for (int i = 0; i < RACES; i++)
+		assert(received[i].load() == 1);
+	pthread_barrier_destroy(&round_begin);
+	pthread_barrier_destroy(&round_end);
+}
+
+// pushing to the less loaded of two deques keeps them level: 48 items over
+// 4 deques are at most 2 apart on average, where a random deque a push
+// would leave them 7 apart. A full queue takes every slot of every deque.
+void test_two_choices() {
+	int gaps = 0;
+	for (int fill = 0; fill < 50; fill++) {
+		WSQueue<int> queue(64, 4);
+		for (int i = 0; i < 48; i++)
+			queue.enqueue(i);
+
+		int least = 64, most = 0;
+		for (int i = 0; i < queue.get_deques(); i++) {
+			least = std::min(least, queue.get_deque_size(i));
+			most = std::max(most, queue.get_deque_size(i));
+		}
+		gaps += most - least;
+
+		for (int i = 48; i < 64; i++)
+			queue.enqueue(i);
+		for (int i = 0; i < queue.get_deques(); i++)
+			assert(queue.get_deque_size(i) == 16);
+		assert(queue.get_size() == 64);
+	}
+	printf("48 items over 4 deques: %.2f apart on average\n", gaps / 50.0);
+	assert(gaps <= 50 * 3.5);
+}
+
+void* wait_cancelled(void* arg) {
+	WSQueue<int>* queue = (WSQueue<int>*)arg;
+	int items[BULK];
+	assert(queue->dequeue_bulk(items, BULK, &done) == 0);
+	return nullptr;
+}
+
+void* drain_later(void* arg) {
+	WSQueue<int>* queue = (WSQueue<int>*)arg;
+	usleep(20000);
+	int items[BULK];
+	assert(queue->dequeue_bulk(items, BULK) > 0);
+	return nullptr;
+}
+
+// a dequeue_bulk asleep on an empty queue returns 0 once cancelled, and an
+// enqueue asleep on a full queue goes on once a dequeue makes room
+void test_sleep() {
+	WSQueue<int> queue(4, 2);
+	pthread_t t;
+
+	done.store(false);
+	pthread_create(&t, 0, wait_cancelled, (void*)&queue);
+	usleep(20000);
+	done.store(true);
+	queue.wake_dequeuers();
+	pthread_join(t, 0);
+
+	for (int i = 0; i < 4; i++)
+		queue.enqueue(i);
+	pthread_create(&t, 0, drain_later, (void*)&queue);
+	queue.enqueue(4);
+	pthread_join(t, 0);
+	assert(queue.get_size() > 0 && queue.get_size() <= 4);
+}
+
+int main() {
+	test_two_choices();
+	test_steal();
+	test_sleep();
+	test_last_item_race();
+	test_exactly_once();
+	printf("ws_queue_test passed\n");
+	return 0;
+}